@@ -1,17 +1,32 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE             // sendmmsg()
+#endif
 #include <errno.h>
 #include <fcntl.h>
 #include <glob.h>
 #include <gst/gst.h>
+#include <gst/allocators/allocators.h>
+#include <gst/app/gstappsink.h>
+#include <gst/video/video.h>
+#include <ifaddrs.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
 #include <poll.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 #include <termios.h>
 #include <unistd.h>
 #include <glib.h>
 #include <glib/gstdio.h>
+#include <gio/gio.h>
 #include <jansson.h>
 #include "grpc_wrapper.h"
+#include "tx_counters.h"
 
 #ifdef __APPLE__
 #include <TargetConditionals.h>
@@ -26,11 +41,34 @@
 #include <avahi-glib/glib-watch.h>
 #endif
 
+#if defined(__linux__) && !defined(UDP_SEGMENT)
+#define UDP_SEGMENT 103         // linux/udp.h, missing from older libc headers
+#endif
+
 #define GRPC_PORT 50051
+#define METRICS_PORT 9464              // OpenMetrics over HTTP; F1SH_METRICS_PORT=0 disables
+#define METRICS_BUFFER_SIZE (64 * 1024)
+#define METRICS_REQUEST_TIMEOUT_MS 1000 // whole request line, so a trickling client cannot stall scrapes
 #define DEFAULT_SERIAL_DEVICE "/dev/ttyGS0"
 #define DEFAULT_WIFI_INTERFACE "wlan0"
 #define DEFAULT_CONFIG_FILENAME "config.json"
 #define SERIAL_PARTIAL_TIMEOUT_USEC (300 * 1000) // 300ms
+#define RENEGOTIATE_TIMEOUT_USEC (1500 * 1000) // give caps 1.5s to propagate before rebuilding
+#define CAMERA_ACQUIRE_INITIAL_BACKOFF_USEC (5 * 1000)  // first retry after 5ms
+#define CAMERA_ACQUIRE_MAX_BACKOFF_USEC (200 * 1000)    // cap retry interval at 200ms
+#define CAMERA_ACQUIRE_TIMEOUT_USEC (5 * 1000 * 1000)   // give up on a busy device after 5s
+#define RATE_WINDOW_SECONDS 60       // per-second samples kept for windowed rates
+#define BITRATE_EWMA_ALPHA 0.3        // weight of the newest one-second sample
+#define LATENCY_BUCKET_USEC 500       // latency histogram resolution
+#define LATENCY_BUCKETS 1000          // 0-500ms; slower buffers land in the last bucket
+#define BITRATE_FEEDBACK_MAX_AGE_USEC (5 * 1000 * 1000) // ignore receiver feedback older than 5s
+#define BITRATE_INCREASE_HOLDOFF_USEC (3 * 1000 * 1000) // no probing up for 3s after a decrease
+#define BITRATE_LOSS_DECREASE 0.10    // loss above this cuts the bitrate
+#define BITRATE_LOSS_INCREASE 0.02    // loss below this lets the bitrate grow
+#define MAX_RTCP_RECEIVERS 8          // receivers reported through GetStats
+#define RTP_H264_CLOCK_RATE 90000
+#define FRAME_SIZE_BUCKETS 11         // 1 KiB doubling to 512 KiB, then overflow
+#define STANDBY_SWAP_TIMEOUT_USEC (5 * 1000 * 1000)     // rebuild if a standby encoder shows no IDR in 5s
 
 // Default configuration
 #define DEFAULT_HOST "127.0.0.1"
@@ -38,6 +76,35 @@
 #define DEFAULT_WIDTH 1280
 #define DEFAULT_HEIGHT 720
 #define DEFAULT_FRAMERATE 30
+#define DEFAULT_SOURCE_TYPE "libcamera"
+#define DEFAULT_V4L2_DEVICE "/dev/video0"
+#define DEFAULT_TEST_PATTERN "smpte"
+#define DEFAULT_TEST_MOTION "wavy"
+#define DEFAULT_CAPTURE_MODE "auto"
+#define DEFAULT_PIXEL_FORMAT "auto"  // first raw format shared by source and encoder
+#define DEFAULT_FEC "none"
+#define DEFAULT_FEC_PERCENTAGE 20
+#define ULPFEC_PAYLOAD_TYPE 122       // RED-less ULPFEC packets share the media SSRC under this PT
+#define ST2022_FEC_PORT_OFFSET 2      // column FEC goes to the RTP port + 2, as in SMPTE 2022-1
+#define DEFAULT_RTX_HISTORY_MS 1000
+#define MAX_DESTINATIONS 16           // extra receivers on top of config.host:config.port
+#define DEFAULT_TX_MODE "udpsink"
+#define TX_BATCH_MAX_PACKETS 64       // also the kernel's limit on UDP GSO segments per send
+#define TX_GSO_MAX_BYTES 65000        // one GSO send must fit in a single UDP datagram
+#define TX_MAX_MESSAGES (TX_BATCH_MAX_PACKETS * (MAX_DESTINATIONS + 1))
+#define TX_SENDMMSG_MAX 1024          // UIO_MAXIOV
+#define DEFAULT_PACING_MAX_DELAY_MS 40
+#define DEFAULT_RTP_MTU 1400          // rtph264pay's own default, used when no interface rule matches
+#define DEFAULT_RTP_AGGREGATE "none"
+#define MAX_DSCP 63
+#define MAX_SOCKET_PRIORITY 6         // highest SO_PRIORITY without CAP_NET_ADMIN
+#define MAX_SEND_BUFFER_KB 65536
+#define PACER_BURST_USEC 2000         // sending time a packet may go out ahead of the pacing rate
+#define H264_PAYLOAD_TYPE 96
+#define RTX_PAYLOAD_TYPE 97           // RFC 4588 retransmissions, SSRC-multiplexed with the media
+#define DEFAULT_BITRATE_KBPS 2048
+#define DEFAULT_MIN_BITRATE_KBPS 500
+#define DEFAULT_MAX_BITRATE_KBPS 4096
 
 // Application configuration
 typedef struct {
@@ -48,25 +115,148 @@ typedef struct {
     gint width;
     gint height;
     gint framerate;
+    gchar *source_type;     // libcamera, v4l2, videotest or file
+    gchar *source_device;   // v4l2 device node or file location
+    gchar *test_pattern;    // videotestsrc pattern nick
+    gchar *test_motion;     // videotestsrc motion nick
+    gchar *capture_mode;    // auto, dmabuf or system
+    gchar *pixel_format;    // preferred raw format (e.g. NV12, I420) or auto
+    gboolean live_renegotiate; // apply size/framerate changes without rebuilding the pipeline
+    gboolean standby_swap;     // switch encoders on a warm standby branch instead of rebuilding
+    gboolean rtcp;             // run the stream through rtpbin with RTCP sender/receiver reports
+    gint rtcp_port;            // RTCP port on both ends; 0 means port + 1
+    gint bitrate_kbps;         // encoder bitrate, and the starting point for the adaptive controller
+    gint min_bitrate_kbps;     // adaptive controller bounds
+    gint max_bitrate_kbps;
+    gboolean adaptive_bitrate; // follow receiver loss/RTT feedback between the bounds
+    gchar *fec;                // none, ulpfec or st2022
+    gint fec_percentage;       // FEC overhead relative to media packets
+    gboolean rtx;              // answer RTCP NACKs with RFC 4588 retransmissions (needs rtcp)
+    gint rtx_history_ms;       // how far back sent packets are kept for retransmission
+    gchar *tx_mode;            // udpsink (GStreamer multiudpsink) or batched (sendmmsg/UDP GSO per frame)
+    gdouble pacing_factor;     // pace sends at this multiple of the bitrate target; 0 disables
+    gint pacing_max_delay_ms;  // longest a packet may be held back by the pacer
+    gint rtp_mtu;              // max RTP packet size; 0 picks one for the egress interface
+    gchar *rtp_aggregate;      // rtph264pay aggregate-mode: none, zero-latency or max-stap (STAP-A)
+    gint dscp;                 // QoS profile: DSCP code point for media/RTCP/FEC, 0 leaves packets unmarked
+    gint socket_priority;      // SO_PRIORITY (Linux qdisc band), 0 leaves the kernel's choice
+    gint send_buffer_kb;       // SO_SNDBUF, 0 keeps the system default
 } AppConfig;
 
+// Traffic during one sampling interval (about a second)
+typedef struct {
+    guint64 bytes;
+    guint64 packets;
+    guint64 frames;
+    gdouble seconds;
+} RateSample;
+
+// Latest RTCP receiver report from one receiver of our stream
+typedef struct {
+    guint32 ssrc;
+    gchar address[64];              // where its RTCP came from
+    gdouble fraction_lost;          // 0..1 over the last report interval
+    gint64 packets_lost;            // cumulative
+    gdouble jitter_ms;
+    gdouble rtt_ms;                 // 0 until a report referencing one of our SRs arrives
+} ReceiverReport;
+
 // Statistics structure
 typedef struct _StreamStats {
-    guint64 total_bytes;
-    guint64 frame_count;
-    gdouble current_bitrate;        // kbps
+    TxCounters tx;                  // lock-free; everything below is guarded by stats_mutex
+    gdouble current_bitrate;        // kbps over the last second
     GstClockTime start_time;
+    atomic_uint_fast64_t dmabuf_buffers; // lock-free: encoder input buffers backed by DMABuf memory
+    atomic_uint_fast64_t system_buffers; // lock-free: encoder input buffers in system memory
+    atomic_uint_fast64_t encoded_frames; // lock-free: access units leaving h264parse
+    atomic_uint_fast64_t keyframes;      // lock-free: of which IDR/keyframes
+    atomic_uint_fast64_t encoded_bytes;  // lock-free: H.264 payload before RTP packetization
+    atomic_uint_fast64_t fec_packets;    // lock-free: FEC packets produced
+    atomic_uint_fast64_t fec_bytes;      // lock-free: of which bytes
+    atomic_uint_fast64_t rtx_requests;   // lock-free: NACKed packets asked of rtprtxsend
+    atomic_uint_fast64_t rtx_packets;    // lock-free: retransmissions sent
+    atomic_uint_fast64_t rtx_bytes;      // lock-free: of which bytes
+    atomic_uint_fast64_t tx_syscalls;    // lock-free: send calls made by the branch sink
+    atomic_uint_fast64_t tx_batches;     // lock-free: of which batches (about one per frame)
+    atomic_uint_fast64_t tx_gso_sends;   // lock-free: messages the kernel segmented with UDP GSO
+    atomic_uint_fast64_t paced_packets;  // lock-free: packets through the pacer
+    atomic_uint_fast64_t pacing_delay_usec; // lock-free: summed time packets waited for tokens
+    atomic_int_fast64_t pacing_delay_max_usec;
+    atomic_uint_fast64_t pacing_overruns; // lock-free: bursts the pacer let through to stay within max delay
+    atomic_int pacing_queued;            // lock-free: packets waiting in the pace queue
+    atomic_int pacing_queued_max;
+    atomic_int rtp_mtu;                  // lock-free: MTU the payloaders are running with
+    atomic_uint_fast64_t tx_enobufs;     // lock-free: packets the batched transmitter had refused with ENOBUFS
+    atomic_int_fast64_t switch_started;  // lock-free: monotonic time of a pending destination switch, 0 if none
+    atomic_int_fast64_t last_switch_usec; // lock-free: switch request to the first IDR sent to the new host
+    guint dmabuf_fallbacks;         // times the DMABuf path was abandoned for the copy path
+    gboolean zero_copy_active;      // current pipeline imports DMABufs into the encoder
+    gboolean conversion_in_path;    // videoconvert sits between capsfilter and encoder
+    gchar negotiated_format[16];    // raw format shared by source and encoder, empty if converted
+    guint renegotiations;           // size/framerate changes applied in place
+    guint renegotiation_fallbacks;  // in-place attempts that ended in a full rebuild
+    gdouble last_renegotiation_ms;  // time for the last in-place change to reach the capsfilter
+    guint restarts;                 // full pipeline rebuilds since startup
+    gdouble restart_ms_total;       // summed teardown-to-PLAYING time of those rebuilds
+    gdouble last_restart_ms;        // teardown-to-PLAYING time of the last rebuild
+    gdouble last_release_wait_ms;   // part of it spent waiting for the capture device
+    guint standby_swaps;            // encoder changes completed on a standby branch
+    guint standby_swap_fallbacks;   // standby attempts that ended in a full rebuild
+    gdouble last_standby_swap_ms;   // standby branch creation to first IDR on the wire
+    guint destination_switches;     // host/port changes applied to the running sinks
+    guint64 sndbuf_errors_base;     // UDP SndbufErrors when the pipeline started
+    guint64 kernel_sndbuf_errors;   // since then, sampled once a second by sample_stream_rates()
+    guint64 logged_packets;         // main thread only: packet count at the last progress line
+    RateSample rate_ring[RATE_WINDOW_SECONDS]; // newest at rate_head - 1
+    guint rate_head;
+    guint rate_count;
+    gint64 rate_sampled_at;         // monotonic time of the last sample
+    guint64 rate_last_bytes;        // counter values at the last sample
+    guint64 rate_last_packets;
+    guint64 rate_last_frames;
+    gdouble bitrate_5s;             // kbps
+    gdouble bitrate_60s;            // kbps
+    gdouble bitrate_ewma;           // kbps, smoothed over one-second samples
+    gdouble packet_rate_1s;         // packets per second
+    gdouble frame_rate_1s;          // encoded frames per second
+    gdouble frame_rate_5s;
+    ReceiverReport receivers[MAX_RTCP_RECEIVERS]; // refreshed once a second from the RTP session
+    guint num_receivers;
+    gint64 receivers_sampled_at;
+    guint target_bitrate_kbps;      // bitrate the encoder is currently set to
+    guint bitrate_increases;        // adaptive controller decisions
+    guint bitrate_decreases;
+    gchar bitrate_decision[32];     // reason for the last change: loss, rtt, probe, config
+    gdouble feedback_loss;          // loss and RTT the controller last acted on
+    gdouble feedback_rtt_ms;
     GMutex stats_mutex;
 } StreamStats;
 
+// Serial status codes counted individually by the metrics endpoint; the rest share "other"
+static const gint serial_metric_codes[] = { 1, 5, 21, 22, 23, 24 };
+#define SERIAL_METRIC_SLOTS (G_N_ELEMENTS(serial_metric_codes) + 1)
+
 typedef struct {
     int fd;
     GThread *thread;
     GMutex write_mutex;
     gint running;
     gchar *device_path;
+    atomic_uint_fast64_t requests[SERIAL_METRIC_SLOTS];  // reader thread only writes
+    atomic_uint_fast64_t failures[SERIAL_METRIC_SLOTS];
 } SerialContext;
 
+// Minimal HTTP listener serving /metrics. Scrapes are rendered one at a time on its
+// own thread into a buffer allocated once at startup.
+typedef struct {
+    int listen_fd;
+    GThread *thread;
+    gint running;
+    gchar *buffer;
+    gsize length;
+    gboolean truncated;
+} MetricsServer;
+
 typedef struct {
     gchar *ssid;
     gchar *bssid;
@@ -82,6 +272,216 @@ typedef struct {
 } MDNSContext;
 #endif
 
+// Points in the chain where buffer age (running time now minus buffer PTS) is sampled
+typedef enum {
+    LATENCY_STAGE_SOURCE,
+    LATENCY_STAGE_CAPSFILTER,
+    LATENCY_STAGE_CONVERT,
+    LATENCY_STAGE_QUEUE,
+    LATENCY_STAGE_ENCODER,
+    LATENCY_STAGE_PARSER,
+    LATENCY_STAGE_PAYLOADER,
+    LATENCY_STAGE_SINK,
+    LATENCY_STAGE_COUNT
+} LatencyStageId;
+
+static const gchar *latency_stage_names[LATENCY_STAGE_COUNT] = {
+    "source", "capsfilter", "convert", "queue", "encoder", "parser", "payloader", "sink"
+};
+
+// Histogram of buffer age leaving one stage. Buckets are bumped lock-free from the
+// streaming threads of every pad probed for the stage.
+typedef struct {
+    gchar element[32];          // element probed in the current pipeline, empty if none
+    atomic_uint buckets[LATENCY_BUCKETS];
+    atomic_uint_fast64_t samples;
+    atomic_uint_fast64_t max_usec;
+} LatencyStage;
+
+// One probed pad. The segment is only touched by that pad's streaming thread; an encode
+// branch's probes only sample while its gate is open, so a standby encoder warming up
+// during a swap does not show up in the histograms.
+typedef struct {
+    LatencyStage *stage;
+    const gint *gate;           // EncodeBranch.gate_open, NULL for the shared source stages
+    GstSegment segment;
+} LatencyProbe;
+
+// Coded picture types told apart by the NAL inspector
+typedef enum {
+    FRAME_TYPE_IDR,
+    FRAME_TYPE_I,
+    FRAME_TYPE_P,
+    FRAME_TYPE_B,
+    FRAME_TYPE_COUNT
+} FrameType;
+
+static const gchar *frame_type_names[FRAME_TYPE_COUNT] = { "IDR", "I", "P", "B" };
+
+typedef struct {
+    atomic_uint_fast64_t frames;
+    atomic_uint_fast64_t bytes;
+    atomic_uint_fast64_t max_bytes;
+    atomic_uint_fast64_t buckets[FRAME_SIZE_BUCKETS];
+} FrameSizeStats;
+
+// Frame size and GOP structure of the encoded stream, filled in by the parser probe of
+// the branch currently on the wire. Counters are lock-free; the GOP tracking state is
+// only touched by that streaming thread.
+typedef struct {
+    FrameSizeStats types[FRAME_TYPE_COUNT];
+    atomic_uint_fast64_t sps;           // SPS NAL units seen
+    atomic_uint_fast64_t pps;           // PPS NAL units seen
+    atomic_uint_fast64_t gops;          // completed IDR-to-IDR intervals
+    atomic_uint_fast64_t gop_frames;    // frames in those intervals
+    atomic_uint last_gop;
+    atomic_uint min_gop;                // 0 until the first interval completes
+    atomic_uint max_gop;
+    guint frames_since_idr;
+    gboolean seen_idr;
+} FrameAnalytics;
+
+// A camera seen by the device monitor
+typedef struct {
+    GstDevice *device;
+    gchar *name;
+    gchar *path;                // device node, or the camera name for libcamera
+    gchar *caps;                // supported caps as a string
+} CameraEntry;
+
+typedef struct {
+    GstDeviceMonitor *monitor;
+    GPtrArray *table;           // CameraEntry*, guarded by mutex
+    GMutex mutex;
+} CameraMonitor;
+
+// H.264 encoders in order of preference; the configured encoder is always tried first
+static const gchar *known_encoders[] = {
+    "v4l2h264enc",             // Hardware encoder (Pi default)
+    "omxh264enc",              // OpenMAX encoder (Pi fallback)
+    "x264enc",                 // Software fallback
+    "nvh264enc",               // NVIDIA if available
+    "vaapih264enc",            // Intel VAAPI if available
+};
+
+// What an encoder can do on this host, probed once at startup
+typedef struct {
+    const gchar *name;
+    gboolean available;         // factory is installed
+    gboolean ready_ok;          // a test instance reached READY
+    gchar *formats;             // raw formats accepted on the sink pad, comma separated
+    gint max_width;             // 0 when the caps carry no limit
+    gint max_height;
+    gint max_framerate;         // whole frames per second
+} EncoderCapability;
+
+typedef struct {
+    EncoderCapability entries[G_N_ELEMENTS(known_encoders)];
+    GThread *thread;
+    GMutex mutex;
+    GCond cond;
+    gboolean ready;             // entries are filled in and no longer change
+} EncoderRegistry;
+
+// Adaptive bitrate state. Feedback comes from RTCP receiver reports or the
+// ReportReceiverFeedback RPC; the controller runs on the main loop.
+typedef struct {
+    guint target_kbps;          // guarded by state_mutex
+    gdouble rpc_loss;           // last ReportReceiverFeedback, guarded by state_mutex
+    gdouble rpc_rtt_ms;
+    gint64 rpc_received_at;     // 0 once consumed
+    gint64 evaluated_at;        // main loop only from here on
+    gint64 decreased_at;
+    gint64 rtcp_lost_seen;      // cumulative RTCP loss already acted on
+    gdouble min_rtt_ms;         // lowest RTT seen, the uncongested baseline
+} BitrateController;
+
+// rtpbin between payloader and udpsink, plus the RTCP legs: SRs out through rtcp_sink,
+// RRs in through rtcp_src on the same local port. Element pointers are borrowed from the
+// pipeline bin; session is an owned ref to the internal RTPSession for reading reports.
+typedef struct {
+    GstElement *rtpbin;
+    GstElement *rtcp_sink;
+    GstElement *rtcp_src;
+    GObject *session;
+} RtcpSession;
+
+// Receiver fed by the media multiudpsink in addition to config.host:config.port
+typedef struct {
+    gchar *host;
+    gint port;
+} Destination;
+
+// One receiver of the batched transmitter, resolved for its socket
+typedef struct {
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+    gchar host[64];
+    gint port;
+    guint64 bytes_sent;         // guarded by BatchSender.mutex
+    guint64 packets_sent;
+} TxDestination;
+
+// tx_mode "batched": the branch ends in an appsink and the RTP packets of one access unit
+// go out together, to every destination in a single sendmmsg() on Linux. Runs of equal-sized
+// packets (FU-A fragments) travel as one UDP GSO message each while the kernel allows it.
+typedef struct {
+    GMutex mutex;               // guards destinations, counters and the send scratch space
+    TxDestination destinations[MAX_DESTINATIONS + 1];
+    guint num_destinations;
+    int fd;
+    int family;                 // AF_INET6 (dual-stack, IPv4 as v4-mapped) or AF_INET
+    gboolean gso;               // cleared when the kernel or route rejects UDP_SEGMENT
+    guint pacing_kbps;          // pacing rate per destination, 0 when not pacing
+    GstBuffer *pending[TX_BATCH_MAX_PACKETS]; // appsink streaming thread only
+    guint pending_count;
+    StreamStats *stats;
+#ifdef __linux__
+    struct mmsghdr messages[TX_MAX_MESSAGES];
+    guint8 message_destination[TX_MAX_MESSAGES];
+    guint8 message_packets[TX_MAX_MESSAGES];
+    union {
+        struct cmsghdr align;
+        gchar buffer[CMSG_SPACE(sizeof(guint16))];
+    } control[TX_BATCH_MAX_PACKETS];
+#endif
+} BatchSender;
+
+// Token bucket in front of the UDP sink. It runs in the pace queue's thread, so waiting for
+// tokens delays packets without stalling the encoder. The bucket never owes more than
+// max_delay_usec of sending time: a burst the rate cannot absorb within that is let through.
+typedef struct {
+    atomic_uint rate_kbps;      // pacing_factor × bitrate target, 0 passes packets straight through
+    atomic_int max_delay_usec;
+    gint64 next_send;           // pace queue thread only: when the bucket is next empty
+} Pacer;
+
+// Encoder → encoder caps → h264parse → rtph264pay → udpsink. With standby swapping the
+// branch hangs off the capture tee through a queue, and a second branch can be built next
+// to the running one. Element pointers are borrowed from the pipeline bin.
+typedef struct _EncodeBranch {
+    struct _CustomData *owner;
+    guint generation;
+    GstElement *queue;          // NULL unless fed from the tee
+    GstPad *tee_pad;            // owned ref to the tee request pad feeding the queue
+    GstElement *encoder;
+    GstElement *encoder_caps;
+    GstElement *parser;
+    GstElement *payloader;
+    GstElement *fec;            // FEC encoder after the payloader, NULL when disabled
+    GstElement *fec_sink;       // udpsink for SMPTE 2022-1 column FEC, NULL otherwise
+    GstElement *pace_queue;     // decouples the pacer from the encoder, NULL when not pacing
+    GstElement *sink;           // multiudpsink, or an appsink feeding tx
+    BatchSender *tx;            // batched transmitter, NULL with tx_mode udpsink
+    Pacer pacer;
+    gchar *encoder_name;        // factory actually used after fallbacks
+    gboolean dmabuf_import;     // encoder imports the source's DMABufs
+    gint gate_open;             // atomic: payloader output reaches the sink only while set
+    gint keyframe_seen;         // atomic: standby branch has put its first IDR on the wire
+    guint nal_length_size;      // parser streaming thread: AVC length prefix size, 0 for byte-stream
+    struct _EncodeBranch *replaces; // branch silenced when this one opens
+} EncodeBranch;
+
 typedef struct _CustomData {
     GstElement *pipeline;
     GstBus *bus;
@@ -91,7 +491,27 @@ typedef struct _CustomData {
     GMutex state_mutex;
     gboolean pipeline_is_restarting;
     gboolean should_terminate;
+    gboolean dmabuf_path_active;    // current pipeline was built for DMABuf import
+    gboolean dmabuf_import_failed;  // sticky until source/encoder/capture mode changes
+    gboolean convert_in_path;       // current pipeline was built with videoconvert
+    gboolean convert_forced;        // sticky: running without videoconvert failed to negotiate
+    gboolean pipeline_needs_renegotiate; // main loop should push new caps into the running pipeline
+    gint64 renegotiate_started;     // monotonic time of the pending in-place change, 0 if none
+    EncodeBranch *active_branch;    // branch currently feeding the network
+    EncodeBranch *standby_branch;   // branch warming up for an encoder change, NULL if none
+    guint branch_generation;        // suffix for the next standby branch's element names
+    gboolean pipeline_needs_branch_swap; // main loop should build a standby branch
+    gint64 standby_started;         // monotonic time the standby branch was linked
     SerialContext serial;
+    MetricsServer metrics;
+    RtcpSession rtcp;
+    GPtrArray *destinations;        // Destination*, extra receivers; guarded by state_mutex
+    atomic_uint rtp_seqnum;         // lock-free: next RTP sequence number of tee-fed branches
+    BitrateController bitrate;
+    EncoderRegistry encoders;
+    CameraMonitor cameras;
+    LatencyStage latency[LATENCY_STAGE_COUNT];
+    FrameAnalytics analytics;
     gchar *config_file_path;
 #if HAVE_AVAHI
     MDNSContext mdns;
@@ -100,6 +520,17 @@ typedef struct _CustomData {
 
 // Function declarations
 static gboolean build_and_run_pipeline(CustomData *data);
+static void apply_target_bitrate(CustomData *data, guint kbps, const gchar *reason);
+static gint find_destination(CustomData *data, const gchar *host, gint port);
+static void update_sink_destination(CustomData *data, const gchar *signal, const gchar *host, gint port);
+static gboolean switch_destination(CustomData *data, const gchar *old_host, gint old_port);
+static void update_pacing(CustomData *data);
+static void update_packetization(CustomData *data);
+static void apply_socket_qos(CustomData *data);
+static gboolean read_udp_sndbuf_errors(guint64 *errors);
+static void batch_sender_free(BatchSender *tx);
+static void batch_sender_get_stats(BatchSender *tx, const gchar *host, gint port,
+                                   uint64_t *bytes_sent, uint64_t *packets_sent);
 static void init_config(AppConfig *config);
 static void free_config_members(AppConfig *config);
 static gboolean save_config_to_file(const AppConfig *config, const char *path);
@@ -123,6 +554,7 @@ static gboolean handle_wifi_connect_request(CustomData *data, json_t *payload);
 static gboolean handle_swap_resolution_request(CustomData *data, json_t *payload);
 static gboolean handle_host_update_request(CustomData *data, json_t *payload);
 static gboolean swap_config_resolution(CustomData *data, gint swap, gboolean *persisted_out);
+static void request_resolution_change(CustomData *data);
 static gboolean collect_wifi_networks(json_t **result_array);
 static gboolean serial_write_all(SerialContext *serial, const char *buffer, size_t length);
 static gchar* sanitize_utf8(const gchar *value);
@@ -144,33 +576,63 @@ static gboolean init_mdns_service(CustomData *data);
 static void shutdown_mdns_service(CustomData *data);
 #endif
 
-// Probe callback to monitor data flow
+static gboolean sum_buffer_list_size(GstBuffer **buffer, guint idx __attribute__((unused)), gpointer user_data) {
+    *(guint64 *)user_data += gst_buffer_get_size(*buffer);
+    return TRUE;
+}
+
+// multiudpsink hands each buffer or buffer list it renders to one g_socket_send_messages()
+// (sendmmsg) call, so counting renders gives udpsink mode a comparable tx_syscalls
+static GstPadProbeReturn
+multiudpsink_send_probe_callback (GstPad *pad __attribute__((unused)), GstPadProbeInfo *info __attribute__((unused)),
+                                  gpointer user_data)
+{
+    StreamStats *stats = (StreamStats *)user_data;
+    atomic_fetch_add_explicit(&stats->tx_syscalls, 1, memory_order_relaxed);
+    return GST_PAD_PROBE_OK;
+}
+
+// Probe callback to monitor data flow. Runs for every RTP packet (or packet list, as
+// pushed by rtph264pay) on the udpsink streaming thread, so it only touches atomics;
+// progress is logged from the main loop.
 static GstPadProbeReturn
 udpsink_probe_callback (GstPad *pad __attribute__((unused)), GstPadProbeInfo *info, gpointer user_data)
 {
     CustomData *data = (CustomData *)user_data;
-    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
-    
-    if (buffer) {
-        g_mutex_lock(&data->stats.stats_mutex);
-        
-        // Update byte count and frame count
-        gsize buffer_size = gst_buffer_get_size(buffer);
-        data->stats.total_bytes += buffer_size;
-        data->stats.frame_count++;
-        
-        // Print debug info every 60 frames (about every 1 second at 60fps)
-        if (data->stats.frame_count % 60 == 0) {
-            g_print("Streaming: frame %llu, size %zu bytes, total %llu bytes\n", 
-                    (unsigned long long)data->stats.frame_count, buffer_size, (unsigned long long)data->stats.total_bytes);
+
+    if (info->type & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+        GstBufferList *list = GST_PAD_PROBE_INFO_BUFFER_LIST(info);
+        guint64 bytes = 0;
+        gst_buffer_list_foreach(list, sum_buffer_list_size, &bytes);
+        tx_counters_add(&data->stats.tx, bytes, gst_buffer_list_length(list));
+    } else {
+        GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+        if (buffer) {
+            tx_counters_add(&data->stats.tx, gst_buffer_get_size(buffer), 1);
         }
-        
-        g_mutex_unlock(&data->stats.stats_mutex);
     }
     
     return GST_PAD_PROBE_OK;
 }
 
+// Probe on the encoder sink pad recording whether frames arrive as DMABufs or in system memory
+static GstPadProbeReturn
+encoder_input_probe_callback (GstPad *pad __attribute__((unused)), GstPadProbeInfo *info, gpointer user_data)
+{
+    CustomData *data = (CustomData *)user_data;
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+
+    if (buffer && gst_buffer_n_memory(buffer) > 0) {
+        if (gst_is_dmabuf_memory(gst_buffer_peek_memory(buffer, 0))) {
+            atomic_fetch_add_explicit(&data->stats.dmabuf_buffers, 1, memory_order_relaxed);
+        } else {
+            atomic_fetch_add_explicit(&data->stats.system_buffers, 1, memory_order_relaxed);
+        }
+    }
+
+    return GST_PAD_PROBE_OK;
+}
+
 // Initialize with default values
 void init_config(AppConfig *config) {
     config->host = g_strdup(DEFAULT_HOST);
@@ -180,12 +642,133 @@ void init_config(AppConfig *config) {
     config->width = DEFAULT_WIDTH;
     config->height = DEFAULT_HEIGHT;
     config->framerate = DEFAULT_FRAMERATE;
+    config->source_type = g_strdup(DEFAULT_SOURCE_TYPE);
+    config->source_device = g_strdup("");
+    config->test_pattern = g_strdup(DEFAULT_TEST_PATTERN);
+    config->test_motion = g_strdup(DEFAULT_TEST_MOTION);
+    config->capture_mode = g_strdup(DEFAULT_CAPTURE_MODE);
+    config->pixel_format = g_strdup(DEFAULT_PIXEL_FORMAT);
+    config->live_renegotiate = TRUE;
+    config->standby_swap = FALSE;
+    config->rtcp = FALSE;
+    config->rtcp_port = 0;
+    config->bitrate_kbps = DEFAULT_BITRATE_KBPS;
+    config->min_bitrate_kbps = DEFAULT_MIN_BITRATE_KBPS;
+    config->max_bitrate_kbps = DEFAULT_MAX_BITRATE_KBPS;
+    config->adaptive_bitrate = FALSE;
+    config->fec = g_strdup(DEFAULT_FEC);
+    config->fec_percentage = DEFAULT_FEC_PERCENTAGE;
+    config->rtx = FALSE;
+    config->rtx_history_ms = DEFAULT_RTX_HISTORY_MS;
+    config->tx_mode = g_strdup(DEFAULT_TX_MODE);
+    config->pacing_factor = 0.0;
+    config->pacing_max_delay_ms = DEFAULT_PACING_MAX_DELAY_MS;
+    config->rtp_mtu = 0;
+    config->rtp_aggregate = g_strdup(DEFAULT_RTP_AGGREGATE);
+    config->dscp = 0;
+    config->socket_priority = 0;
+    config->send_buffer_kb = 0;
 }
 
 void free_config_members(AppConfig *config) {
     g_free(config->host);
     g_free(config->camera_name);
     g_free(config->encoder_type);
+    g_free(config->source_type);
+    g_free(config->source_device);
+    g_free(config->test_pattern);
+    g_free(config->test_motion);
+    g_free(config->capture_mode);
+    g_free(config->pixel_format);
+    g_free(config->fec);
+    g_free(config->tx_mode);
+    g_free(config->rtp_aggregate);
+}
+
+// Deep copy; the destination must be released with free_config_members()
+static void copy_config(AppConfig *dst, const AppConfig *src) {
+    *dst = *src;
+    dst->host = g_strdup(src->host);
+    dst->camera_name = g_strdup(src->camera_name);
+    dst->encoder_type = g_strdup(src->encoder_type);
+    dst->source_type = g_strdup(src->source_type);
+    dst->source_device = g_strdup(src->source_device);
+    dst->test_pattern = g_strdup(src->test_pattern);
+    dst->test_motion = g_strdup(src->test_motion);
+    dst->capture_mode = g_strdup(src->capture_mode);
+    dst->pixel_format = g_strdup(src->pixel_format);
+    dst->fec = g_strdup(src->fec);
+    dst->tx_mode = g_strdup(src->tx_mode);
+    dst->rtp_aggregate = g_strdup(src->rtp_aggregate);
+}
+
+static gboolean is_valid_source_type(const char *source_type) {
+    static const char *source_types[] = {"libcamera", "v4l2", "videotest", "file", NULL};
+    if (!source_type) {
+        return FALSE;
+    }
+    for (int i = 0; source_types[i] != NULL; i++) {
+        if (strcmp(source_type, source_types[i]) == 0) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+// Checks a nick against videotestsrc's own enum for the property ("pattern" or "motion"),
+// so the accepted set follows the installed plugin rather than a copied list
+static gboolean is_valid_videotest_nick(const char *property, const char *nick) {
+    if (!nick || nick[0] == '\0') {
+        return FALSE;
+    }
+    GstElementFactory *factory = gst_element_factory_find("videotestsrc");
+    if (!factory) {
+        return FALSE;
+    }
+    GstPluginFeature *loaded = gst_plugin_feature_load(GST_PLUGIN_FEATURE(factory));
+    gst_object_unref(factory);
+    if (!loaded) {
+        return FALSE;
+    }
+    gboolean valid = FALSE;
+    GType type = gst_element_factory_get_element_type(GST_ELEMENT_FACTORY(loaded));
+    GObjectClass *klass = type != G_TYPE_INVALID ? g_type_class_ref(type) : NULL;
+    if (klass) {
+        GParamSpec *pspec = g_object_class_find_property(klass, property);
+        if (pspec && G_IS_PARAM_SPEC_ENUM(pspec)) {
+            valid = g_enum_get_value_by_nick(G_PARAM_SPEC_ENUM(pspec)->enum_class, nick) != NULL;
+        }
+        g_type_class_unref(klass);
+    }
+    gst_object_unref(loaded);
+    return valid;
+}
+
+static gboolean is_valid_capture_mode(const char *capture_mode) {
+    return capture_mode && (strcmp(capture_mode, "auto") == 0 ||
+                            strcmp(capture_mode, "dmabuf") == 0 ||
+                            strcmp(capture_mode, "system") == 0);
+}
+
+static gboolean is_valid_fec_mode(const char *fec) {
+    return fec && (strcmp(fec, "none") == 0 ||
+                   strcmp(fec, "ulpfec") == 0 ||
+                   strcmp(fec, "st2022") == 0);
+}
+
+static gboolean is_valid_tx_mode(const char *tx_mode) {
+    return tx_mode && (strcmp(tx_mode, "udpsink") == 0 ||
+                       strcmp(tx_mode, "batched") == 0);
+}
+
+static gboolean is_valid_rtp_aggregate(const char *mode) {
+    return mode && (strcmp(mode, "none") == 0 ||
+                    strcmp(mode, "zero-latency") == 0 ||
+                    strcmp(mode, "max-stap") == 0);
+}
+
+static gboolean is_valid_rtp_mtu(gint mtu) {
+    return mtu == 0 || (mtu >= 256 && mtu <= 9000);
 }
 
 static gboolean config_file_exists(const char *path) {
@@ -211,6 +794,33 @@ static gboolean save_config_to_file(const AppConfig *config, const char *path) {
     json_object_set_new(root, "width", json_integer(config->width));
     json_object_set_new(root, "height", json_integer(config->height));
     json_object_set_new(root, "framerate", json_integer(config->framerate));
+    json_object_set_new(root, "source", json_string(config->source_type ? config->source_type : DEFAULT_SOURCE_TYPE));
+    json_object_set_new(root, "source_device", json_string(config->source_device ? config->source_device : ""));
+    json_object_set_new(root, "test_pattern", json_string(config->test_pattern ? config->test_pattern : DEFAULT_TEST_PATTERN));
+    json_object_set_new(root, "test_motion", json_string(config->test_motion ? config->test_motion : DEFAULT_TEST_MOTION));
+    json_object_set_new(root, "capture_mode", json_string(config->capture_mode ? config->capture_mode : DEFAULT_CAPTURE_MODE));
+    json_object_set_new(root, "pixel_format", json_string(config->pixel_format ? config->pixel_format : DEFAULT_PIXEL_FORMAT));
+    json_object_set_new(root, "live_renegotiate", json_boolean(config->live_renegotiate));
+    json_object_set_new(root, "standby_swap", json_boolean(config->standby_swap));
+    json_object_set_new(root, "rtcp", json_boolean(config->rtcp));
+    json_object_set_new(root, "rtcp_port", json_integer(config->rtcp_port));
+    json_object_set_new(root, "bitrate_kbps", json_integer(config->bitrate_kbps));
+    json_object_set_new(root, "min_bitrate_kbps", json_integer(config->min_bitrate_kbps));
+    json_object_set_new(root, "max_bitrate_kbps", json_integer(config->max_bitrate_kbps));
+    json_object_set_new(root, "adaptive_bitrate", json_boolean(config->adaptive_bitrate));
+    json_object_set_new(root, "fec", json_string(config->fec ? config->fec : DEFAULT_FEC));
+    json_object_set_new(root, "fec_percentage", json_integer(config->fec_percentage));
+    json_object_set_new(root, "rtx", json_boolean(config->rtx));
+    json_object_set_new(root, "rtx_history_ms", json_integer(config->rtx_history_ms));
+    json_object_set_new(root, "tx_mode", json_string(config->tx_mode ? config->tx_mode : DEFAULT_TX_MODE));
+    json_object_set_new(root, "pacing_factor", json_real(config->pacing_factor));
+    json_object_set_new(root, "pacing_max_delay_ms", json_integer(config->pacing_max_delay_ms));
+    json_object_set_new(root, "rtp_mtu", json_integer(config->rtp_mtu));
+    json_object_set_new(root, "rtp_aggregate",
+                        json_string(config->rtp_aggregate ? config->rtp_aggregate : DEFAULT_RTP_AGGREGATE));
+    json_object_set_new(root, "dscp", json_integer(config->dscp));
+    json_object_set_new(root, "socket_priority", json_integer(config->socket_priority));
+    json_object_set_new(root, "send_buffer_kb", json_integer(config->send_buffer_kb));
 
     int dump_ret = json_dump_file(root, path, JSON_INDENT(2));
     json_decref(root);
@@ -294,6 +904,202 @@ static gboolean load_config_from_file(AppConfig *config, const char *path) {
         }
     }
 
+    value = json_object_get(root, "source");
+    if (json_is_string(value)) {
+        str_val = json_string_value(value);
+        if (is_valid_source_type(str_val)) {
+            g_free(config->source_type);
+            config->source_type = g_strdup(str_val);
+        } else {
+            g_print("Ignoring unknown source '%s' from %s\n", str_val, path);
+        }
+    }
+
+    value = json_object_get(root, "source_device");
+    if (json_is_string(value)) {
+        str_val = json_string_value(value);
+        g_free(config->source_device);
+        config->source_device = g_strdup(str_val);
+    }
+
+    value = json_object_get(root, "test_pattern");
+    if (json_is_string(value)) {
+        str_val = json_string_value(value);
+        if (is_valid_videotest_nick("pattern", str_val)) {
+            g_free(config->test_pattern);
+            config->test_pattern = g_strdup(str_val);
+        } else {
+            g_print("Ignoring unknown test_pattern '%s' from %s\n", str_val, path);
+        }
+    }
+
+    value = json_object_get(root, "test_motion");
+    if (json_is_string(value)) {
+        str_val = json_string_value(value);
+        if (is_valid_videotest_nick("motion", str_val)) {
+            g_free(config->test_motion);
+            config->test_motion = g_strdup(str_val);
+        } else {
+            g_print("Ignoring unknown test_motion '%s' from %s\n", str_val, path);
+        }
+    }
+
+    value = json_object_get(root, "capture_mode");
+    if (json_is_string(value)) {
+        str_val = json_string_value(value);
+        if (is_valid_capture_mode(str_val)) {
+            g_free(config->capture_mode);
+            config->capture_mode = g_strdup(str_val);
+        } else {
+            g_print("Ignoring unknown capture_mode '%s' from %s\n", str_val, path);
+        }
+    }
+
+    value = json_object_get(root, "pixel_format");
+    if (json_is_string(value)) {
+        str_val = json_string_value(value);
+        g_free(config->pixel_format);
+        config->pixel_format = g_strdup(str_val[0] != '\0' ? str_val : DEFAULT_PIXEL_FORMAT);
+    }
+
+    value = json_object_get(root, "live_renegotiate");
+    if (json_is_boolean(value)) {
+        config->live_renegotiate = json_is_true(value);
+    }
+
+    value = json_object_get(root, "standby_swap");
+    if (json_is_boolean(value)) {
+        config->standby_swap = json_is_true(value);
+    }
+
+    value = json_object_get(root, "rtcp");
+    if (json_is_boolean(value)) {
+        config->rtcp = json_is_true(value);
+    }
+
+    value = json_object_get(root, "rtcp_port");
+    if (json_is_integer(value) && json_integer_value(value) >= 0 && json_integer_value(value) <= 65535) {
+        config->rtcp_port = (gint)json_integer_value(value);
+    }
+    if (config->rtcp && config->rtcp_port == 0 && config->port >= 65535) {
+        g_print("rtcp needs port + 1 or an rtcp_port, RTCP stays off (%s)\n", path);
+        config->rtcp = FALSE;
+    }
+
+    value = json_object_get(root, "bitrate_kbps");
+    if (json_is_integer(value) && json_integer_value(value) > 0) {
+        config->bitrate_kbps = (gint)json_integer_value(value);
+    }
+
+    value = json_object_get(root, "min_bitrate_kbps");
+    if (json_is_integer(value) && json_integer_value(value) > 0) {
+        config->min_bitrate_kbps = (gint)json_integer_value(value);
+    }
+
+    value = json_object_get(root, "max_bitrate_kbps");
+    if (json_is_integer(value) && json_integer_value(value) > 0) {
+        config->max_bitrate_kbps = (gint)json_integer_value(value);
+    }
+    if (config->min_bitrate_kbps > config->max_bitrate_kbps) {
+        g_print("Ignoring min_bitrate_kbps %d above max_bitrate_kbps %d from %s\n",
+                config->min_bitrate_kbps, config->max_bitrate_kbps, path);
+        config->min_bitrate_kbps = MIN(DEFAULT_MIN_BITRATE_KBPS, config->max_bitrate_kbps);
+    }
+
+    value = json_object_get(root, "adaptive_bitrate");
+    if (json_is_boolean(value)) {
+        config->adaptive_bitrate = json_is_true(value);
+    }
+
+    value = json_object_get(root, "fec");
+    if (json_is_string(value)) {
+        str_val = json_string_value(value);
+        if (is_valid_fec_mode(str_val)) {
+            g_free(config->fec);
+            config->fec = g_strdup(str_val);
+        } else {
+            g_print("Ignoring unknown fec '%s' from %s\n", str_val, path);
+        }
+    }
+    if (g_strcmp0(config->fec, "st2022") == 0 && config->port > 65535 - ST2022_FEC_PORT_OFFSET) {
+        g_print("st2022 FEC needs port + %d, FEC stays off (%s)\n", ST2022_FEC_PORT_OFFSET, path);
+        g_free(config->fec);
+        config->fec = g_strdup("none");
+    }
+
+    value = json_object_get(root, "fec_percentage");
+    if (json_is_integer(value) && json_integer_value(value) > 0 && json_integer_value(value) <= 100) {
+        config->fec_percentage = (gint)json_integer_value(value);
+    }
+
+    value = json_object_get(root, "rtx");
+    if (json_is_boolean(value)) {
+        config->rtx = json_is_true(value);
+        if (config->rtx && !config->rtcp) {
+            g_print("rtx needs rtcp, retransmission stays off (%s)\n", path);
+            config->rtx = FALSE;
+        }
+    }
+
+    value = json_object_get(root, "rtx_history_ms");
+    if (json_is_integer(value) && json_integer_value(value) > 0) {
+        config->rtx_history_ms = (gint)json_integer_value(value);
+    }
+
+    value = json_object_get(root, "tx_mode");
+    if (json_is_string(value)) {
+        str_val = json_string_value(value);
+        if (is_valid_tx_mode(str_val)) {
+            g_free(config->tx_mode);
+            config->tx_mode = g_strdup(str_val);
+        } else {
+            g_print("Ignoring unknown tx_mode '%s' from %s\n", str_val, path);
+        }
+    }
+
+    value = json_object_get(root, "pacing_factor");
+    if (json_is_number(value) && (json_number_value(value) == 0.0 || json_number_value(value) >= 1.0)) {
+        config->pacing_factor = json_number_value(value);
+    }
+
+    value = json_object_get(root, "pacing_max_delay_ms");
+    if (json_is_integer(value) && json_integer_value(value) > 0 && json_integer_value(value) <= 1000) {
+        config->pacing_max_delay_ms = (gint)json_integer_value(value);
+    }
+
+    value = json_object_get(root, "rtp_mtu");
+    if (json_is_integer(value) && is_valid_rtp_mtu((gint)json_integer_value(value))) {
+        config->rtp_mtu = (gint)json_integer_value(value);
+    }
+
+    value = json_object_get(root, "rtp_aggregate");
+    if (json_is_string(value)) {
+        str_val = json_string_value(value);
+        if (is_valid_rtp_aggregate(str_val)) {
+            g_free(config->rtp_aggregate);
+            config->rtp_aggregate = g_strdup(str_val);
+        } else {
+            g_print("Ignoring unknown rtp_aggregate '%s' from %s\n", str_val, path);
+        }
+    }
+
+    value = json_object_get(root, "dscp");
+    if (json_is_integer(value) && json_integer_value(value) >= 0 && json_integer_value(value) <= MAX_DSCP) {
+        config->dscp = (gint)json_integer_value(value);
+    }
+
+    value = json_object_get(root, "socket_priority");
+    if (json_is_integer(value) && json_integer_value(value) >= 0 &&
+        json_integer_value(value) <= MAX_SOCKET_PRIORITY) {
+        config->socket_priority = (gint)json_integer_value(value);
+    }
+
+    value = json_object_get(root, "send_buffer_kb");
+    if (json_is_integer(value) && json_integer_value(value) >= 0 &&
+        json_integer_value(value) <= MAX_SEND_BUFFER_KB) {
+        config->send_buffer_kb = (gint)json_integer_value(value);
+    }
+
     json_decref(root);
     return TRUE;
 }
@@ -336,10 +1142,45 @@ static gchar* resolve_config_path(void) {
 
 // Initialize statistics
 void init_stats(StreamStats *stats) {
-    stats->total_bytes = 0;
-    stats->frame_count = 0;
+    atomic_init(&stats->tx.seq, 0);
+    atomic_init(&stats->tx.total_bytes, 0);
+    atomic_init(&stats->tx.packets, 0);
     stats->current_bitrate = 0.0;
     stats->start_time = gst_clock_get_time(gst_system_clock_obtain());
+    atomic_init(&stats->dmabuf_buffers, 0);
+    atomic_init(&stats->system_buffers, 0);
+    atomic_init(&stats->encoded_frames, 0);
+    atomic_init(&stats->keyframes, 0);
+    atomic_init(&stats->encoded_bytes, 0);
+    stats->dmabuf_fallbacks = 0;
+    stats->zero_copy_active = FALSE;
+    stats->conversion_in_path = TRUE;
+    stats->negotiated_format[0] = '\0';
+    stats->renegotiations = 0;
+    stats->renegotiation_fallbacks = 0;
+    stats->last_renegotiation_ms = 0.0;
+    stats->restarts = 0;
+    stats->restart_ms_total = 0.0;
+    stats->last_restart_ms = 0.0;
+    stats->last_release_wait_ms = 0.0;
+    stats->standby_swaps = 0;
+    stats->standby_swap_fallbacks = 0;
+    stats->destination_switches = 0;
+    stats->last_standby_swap_ms = 0.0;
+    stats->logged_packets = 0;
+    memset(stats->rate_ring, 0, sizeof(stats->rate_ring));
+    stats->rate_head = 0;
+    stats->rate_count = 0;
+    stats->rate_sampled_at = g_get_monotonic_time();
+    stats->rate_last_bytes = 0;
+    stats->rate_last_packets = 0;
+    stats->rate_last_frames = 0;
+    stats->bitrate_5s = 0.0;
+    stats->bitrate_60s = 0.0;
+    stats->bitrate_ewma = 0.0;
+    stats->packet_rate_1s = 0.0;
+    stats->frame_rate_1s = 0.0;
+    stats->frame_rate_5s = 0.0;
     g_mutex_init(&stats->stats_mutex);
 }
 
@@ -1015,10 +1856,11 @@ static gboolean handle_host_update_request(CustomData *data, json_t *payload) {
 
     gboolean updated = FALSE;
     gboolean persisted = TRUE;
+    gchar *old_host = NULL;
 
     g_mutex_lock(&data->state_mutex);
     if (!data->config.host || strcmp(data->config.host, new_host) != 0) {
-        g_free(data->config.host);
+        old_host = data->config.host;
         data->config.host = g_strdup(new_host);
         updated = TRUE;
 
@@ -1028,19 +1870,11 @@ static gboolean handle_host_update_request(CustomData *data, json_t *payload) {
             persisted = FALSE;
         }
     }
-    GstElement *pipeline = data->pipeline;
-    g_mutex_unlock(&data->state_mutex);
-
-    if (updated && pipeline) {
-        GstElement *sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
-        if (sink) {
-            g_object_set(sink, "host", new_host, NULL);
-            gst_object_unref(sink);
-            g_print("Serial: updated UDP sink host to %s\n", new_host);
-        } else {
-            g_printerr("Serial: could not find UDP sink to update host\n");
-        }
+    if (updated && !switch_destination(data, old_host, data->config.port)) {
+        data->pipeline_is_restarting = TRUE;
     }
+    g_mutex_unlock(&data->state_mutex);
+    g_free(old_host);
 
     if (!persisted) {
         g_printerr("Serial: failed to persist host update\n");
@@ -1049,6 +1883,16 @@ static gboolean handle_host_update_request(CustomData *data, json_t *payload) {
     return respond_with_status(data, 23);
 }
 
+// Schedule a width/height/framerate change. Called with state_mutex held; the main loop
+// either pushes new caps into the running pipeline or rebuilds it.
+static void request_resolution_change(CustomData *data) {
+    if (data->config.live_renegotiate && data->pipeline) {
+        data->pipeline_needs_renegotiate = TRUE;
+    } else {
+        data->pipeline_is_restarting = TRUE;
+    }
+}
+
 static gboolean swap_config_resolution(CustomData *data, gint swap, gboolean *persisted_out) {
     if (!data) {
         return FALSE;
@@ -1067,13 +1911,13 @@ static gboolean swap_config_resolution(CustomData *data, gint swap, gboolean *pe
         gint tmp = data->config.width;
         data->config.width = data->config.height;
         data->config.height = tmp;
-        data->pipeline_is_restarting = TRUE;
+        request_resolution_change(data);
     } else if (swap == 1 && data->config.width > data->config.height) {
         // Currently landscape, swap to portrait
         gint tmp = data->config.width;
         data->config.width = data->config.height;
         data->config.height = tmp;
-        data->pipeline_is_restarting = TRUE;
+        request_resolution_change(data);
     }
 
     gboolean persisted = TRUE;
@@ -1231,7 +2075,20 @@ static void handle_serial_message(CustomData *data, const char *payload, size_t
         return;
     }
 
+    json_t *status_value = json_object_get(root, "status");
+    gsize slot = G_N_ELEMENTS(serial_metric_codes);
+    if (json_is_integer(status_value)) {
+        for (gsize i = 0; i < G_N_ELEMENTS(serial_metric_codes); i++) {
+            if (serial_metric_codes[i] == json_integer_value(status_value)) {
+                slot = i;
+                break;
+            }
+        }
+    }
+    atomic_fetch_add_explicit(&data->serial.requests[slot], 1, memory_order_relaxed);
+
     if (!process_serial_request(data, root)) {
+        atomic_fetch_add_explicit(&data->serial.failures[slot], 1, memory_order_relaxed);
         g_printerr("Serial: failed to handle request\n");
     }
 
@@ -1375,61 +2232,802 @@ static void shutdown_serial_context(CustomData *data) {
     g_mutex_clear(&serial->write_mutex);
 }
 
-// ==================== gRPC Callback Implementations ====================
+// ==================== Latency Instrumentation ====================
 
-// Health check callback
-static void grpc_health_cb(void* user_data, char** status_out) {
-    *status_out = strdup("healthy");
-}
+// Runs on the streaming thread of the probed pad: remembers the segment so PTS can be
+// turned into running time, and files each buffer's age into the stage histogram
+static GstPadProbeReturn
+latency_probe_callback (GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    LatencyProbe *probe = (LatencyProbe *)user_data;
+    LatencyStage *stage = probe->stage;
+
+    if (info->type & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+        GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+        if (GST_EVENT_TYPE(event) == GST_EVENT_SEGMENT) {
+            const GstSegment *segment = NULL;
+            gst_event_parse_segment(event, &segment);
+            gst_segment_copy_into(segment, &probe->segment);
+        }
+        return GST_PAD_PROBE_OK;
+    }
+    if (probe->gate && !g_atomic_int_get(probe->gate)) {
+        return GST_PAD_PROBE_OK;
+    }
 
-// Get stats callback
-static void grpc_get_stats_cb(void* user_data, uint64_t* total_bytes,
-                               uint64_t* frame_count, double* bitrate) {
-    CustomData *data = (CustomData*)user_data;
-    g_mutex_lock(&data->stats.stats_mutex);
+    GstBuffer *buffer = NULL;
+    if (info->type & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+        GstBufferList *list = GST_PAD_PROBE_INFO_BUFFER_LIST(info);
+        buffer = gst_buffer_list_length(list) > 0 ? gst_buffer_list_get(list, 0) : NULL;
+    } else {
+        buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    }
+    if (!buffer || !GST_BUFFER_PTS_IS_VALID(buffer) || probe->segment.format != GST_FORMAT_TIME) {
+        return GST_PAD_PROBE_OK;
+    }
+
+    // The element holds a ref on its clock while PLAYING; no need to take our own
+    GstElement *element = GST_ELEMENT_CAST(GST_PAD_PARENT(pad));
+    GstClock *clock = element ? GST_ELEMENT_CLOCK(element) : NULL;
+    if (!clock) {
+        return GST_PAD_PROBE_OK;
+    }
+    GstClockTime now = gst_clock_get_time(clock);
+    GstClockTime base_time = GST_ELEMENT_CAST(element)->base_time;
+    GstClockTime running_pts = gst_segment_to_running_time(&probe->segment, GST_FORMAT_TIME,
+                                                           GST_BUFFER_PTS(buffer));
+    if (running_pts == GST_CLOCK_TIME_NONE || now < base_time) {
+        return GST_PAD_PROBE_OK;
+    }
 
-    *total_bytes = data->stats.total_bytes;
-    *frame_count = data->stats.frame_count;
+    GstClockTime running_now = now - base_time;
+    guint64 age_usec = running_now > running_pts ? (running_now - running_pts) / GST_USECOND : 0;
+    guint bucket = MIN(age_usec / LATENCY_BUCKET_USEC, LATENCY_BUCKETS - 1);
+    atomic_fetch_add_explicit(&stage->buckets[bucket], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stage->samples, 1, memory_order_relaxed);
 
-    // Calculate current bitrate (kbps)
-    GstClockTime current_time = gst_clock_get_time(gst_system_clock_obtain());
-    GstClockTime elapsed = current_time - data->stats.start_time;
-    if (elapsed > 0) {
-        *bitrate = (data->stats.total_bytes * 8.0 * GST_SECOND) / (elapsed * 1000.0);
-    } else {
-        *bitrate = 0.0;
+    guint64 max = atomic_load_explicit(&stage->max_usec, memory_order_relaxed);
+    while (age_usec > max &&
+           !atomic_compare_exchange_weak_explicit(&stage->max_usec, &max, age_usec,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
     }
 
-    g_mutex_unlock(&data->stats.stats_mutex);
+    return GST_PAD_PROBE_OK;
 }
 
-// Get config callback
-static void grpc_get_config_cb(void* user_data, grpc_config_t* config) {
-    CustomData *data = (CustomData*)user_data;
-    g_mutex_lock(&data->state_mutex);
+// Sample buffer age on an element's pad, only while *gate is set if given. Called while
+// building, with state_mutex held. Stages with a gate are named by name_branch_latency_stages().
+static void add_latency_probe(CustomData *data, GstElement *element, const gchar *pad_name, LatencyStageId id,
+                              const gint *gate) {
+    GstPad *pad = gst_element_get_static_pad(element, pad_name);
+    if (!pad) {
+        return;
+    }
+    LatencyProbe *probe = g_new0(LatencyProbe, 1);
+    probe->stage = &data->latency[id];
+    probe->gate = gate;
+    gst_segment_init(&probe->segment, GST_FORMAT_UNDEFINED);
+    if (!gate) {
+        g_strlcpy(probe->stage->element, GST_OBJECT_NAME(element), sizeof(probe->stage->element));
+    }
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST |
+                           GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+                      latency_probe_callback, probe, g_free);
+    gst_object_unref(pad);
+}
 
-    config->host = g_strdup(data->config.host);
-    config->port = data->config.port;
-    config->camera_name = g_strdup(data->config.camera_name);
-    config->encoder_type = g_strdup(data->config.encoder_type);
-    config->width = data->config.width;
-    config->height = data->config.height;
-    config->framerate = data->config.framerate;
+// Point the per-branch stages at the branch feeding the network. Called with state_mutex held.
+static void name_branch_latency_stages(CustomData *data, EncodeBranch *branch) {
+    struct {
+        LatencyStageId id;
+        GstElement *element;
+    } stages[] = {
+        {LATENCY_STAGE_QUEUE, branch->queue},
+        {LATENCY_STAGE_ENCODER, branch->encoder},
+        {LATENCY_STAGE_PARSER, branch->parser},
+        {LATENCY_STAGE_PAYLOADER, branch->payloader},
+        {LATENCY_STAGE_SINK, branch->sink},
+    };
+    for (gsize i = 0; i < G_N_ELEMENTS(stages); i++) {
+        if (stages[i].element) {
+            g_strlcpy(data->latency[stages[i].id].element, GST_OBJECT_NAME(stages[i].element),
+                      sizeof(data->latency[stages[i].id].element));
+        }
+    }
+}
 
-    g_mutex_unlock(&data->state_mutex);
+static void reset_latency_histograms(CustomData *data) {
+    for (int i = 0; i < LATENCY_STAGE_COUNT; i++) {
+        LatencyStage *stage = &data->latency[i];
+        for (int b = 0; b < LATENCY_BUCKETS; b++) {
+            atomic_store_explicit(&stage->buckets[b], 0, memory_order_relaxed);
+        }
+        atomic_store_explicit(&stage->samples, 0, memory_order_relaxed);
+        atomic_store_explicit(&stage->max_usec, 0, memory_order_relaxed);
+    }
 }
 
-// Update config callback
-static int grpc_update_config_cb(void* user_data, const grpc_config_update_t* update,
-                                  grpc_config_t* new_config, char** error_msg) {
-    CustomData *data = (CustomData*)user_data;
-    gboolean needs_rebuild = FALSE;
-    gboolean needs_host_update = FALSE;
-    gboolean needs_port_update = FALSE;
+// Upper edge of the bucket holding the given quantile, in milliseconds
+static gdouble latency_percentile_ms(const guint *counts, guint64 total, gdouble quantile) {
+    if (total == 0) {
+        return 0.0;
+    }
+    guint64 rank = (guint64)(quantile * total);
+    if (rank >= total) {
+        rank = total - 1;
+    }
+    guint64 seen = 0;
+    for (int b = 0; b < LATENCY_BUCKETS; b++) {
+        seen += counts[b];
+        if (seen > rank) {
+            return (b + 1) * LATENCY_BUCKET_USEC / 1000.0;
+        }
+    }
+    return LATENCY_BUCKETS * LATENCY_BUCKET_USEC / 1000.0;
+}
 
-    g_mutex_lock(&data->state_mutex);
+// ==================== End of Latency Instrumentation ====================
 
-    // Apply updates
+// ==================== Encoder Registry ====================
+
+// Largest integer a caps field allows (plain int, range or list); 0 if it carries none
+static gint caps_value_max_int(const GValue *value) {
+    if (!value) {
+        return 0;
+    }
+    if (G_VALUE_HOLDS_INT(value)) {
+        return g_value_get_int(value);
+    }
+    if (GST_VALUE_HOLDS_INT_RANGE(value)) {
+        return gst_value_get_int_range_max(value);
+    }
+    if (GST_VALUE_HOLDS_LIST(value)) {
+        gint max = 0;
+        for (guint i = 0; i < gst_value_list_get_size(value); i++) {
+            max = MAX(max, caps_value_max_int(gst_value_list_get_value(value, i)));
+        }
+        return max;
+    }
+    return 0;
+}
+
+// Highest whole frame rate a caps "framerate" field allows; 0 if it carries none
+static gint caps_value_max_fps(const GValue *value) {
+    if (!value) {
+        return 0;
+    }
+    if (GST_VALUE_HOLDS_FRACTION(value)) {
+        gint d = gst_value_get_fraction_denominator(value);
+        return d > 0 ? gst_value_get_fraction_numerator(value) / d : 0;
+    }
+    if (GST_VALUE_HOLDS_FRACTION_RANGE(value)) {
+        return caps_value_max_fps(gst_value_get_fraction_range_max(value));
+    }
+    if (GST_VALUE_HOLDS_LIST(value)) {
+        gint max = 0;
+        for (guint i = 0; i < gst_value_list_get_size(value); i++) {
+            max = MAX(max, caps_value_max_fps(gst_value_list_get_value(value, i)));
+        }
+        return max;
+    }
+    return 0;
+}
+
+static void append_caps_format(GPtrArray *formats, const GValue *value) {
+    if (G_VALUE_HOLDS_STRING(value)) {
+        const gchar *format = g_value_get_string(value);
+        for (guint i = 0; i < formats->len; i++) {
+            if (strcmp(g_ptr_array_index(formats, i), format) == 0) {
+                return;
+            }
+        }
+        g_ptr_array_add(formats, g_strdup(format));
+    } else if (GST_VALUE_HOLDS_LIST(value)) {
+        for (guint i = 0; i < gst_value_list_get_size(value); i++) {
+            append_caps_format(formats, gst_value_list_get_value(value, i));
+        }
+    }
+}
+
+// Instantiate one encoder, bring it to READY (which opens hardware encoders) and read
+// what its sink pad accepts there
+static void probe_encoder_capability(EncoderCapability *cap) {
+    GstElementFactory *factory = gst_element_factory_find(cap->name);
+    if (!factory) {
+        return;
+    }
+    cap->available = TRUE;
+
+    GstElement *encoder = gst_element_factory_create(factory, NULL);
+    gst_object_unref(factory);
+    if (!encoder) {
+        return;
+    }
+    gst_object_ref_sink(encoder);
+
+    GstStateChangeReturn ret = gst_element_set_state(encoder, GST_STATE_READY);
+    if (ret != GST_STATE_CHANGE_FAILURE) {
+        cap->ready_ok = TRUE;
+    }
+
+    GstPad *pad = gst_element_get_static_pad(encoder, "sink");
+    GstCaps *caps = pad ? gst_pad_query_caps(pad, NULL) : NULL;
+    if (caps) {
+        GPtrArray *formats = g_ptr_array_new_with_free_func(g_free);
+        for (guint i = 0; i < gst_caps_get_size(caps); i++) {
+            GstStructure *st = gst_caps_get_structure(caps, i);
+            if (!gst_structure_has_name(st, "video/x-raw")) {
+                continue;
+            }
+            append_caps_format(formats, gst_structure_get_value(st, "format"));
+            cap->max_width = MAX(cap->max_width, caps_value_max_int(gst_structure_get_value(st, "width")));
+            cap->max_height = MAX(cap->max_height, caps_value_max_int(gst_structure_get_value(st, "height")));
+            cap->max_framerate = MAX(cap->max_framerate,
+                                     caps_value_max_fps(gst_structure_get_value(st, "framerate")));
+        }
+        g_ptr_array_add(formats, NULL);
+        cap->formats = g_strjoinv(",", (gchar **)formats->pdata);
+        g_ptr_array_free(formats, TRUE);
+        gst_caps_unref(caps);
+    }
+    if (pad) {
+        gst_object_unref(pad);
+    }
+
+    gst_element_set_state(encoder, GST_STATE_NULL);
+    gst_object_unref(encoder);
+}
+
+static gpointer encoder_registry_thread(gpointer user_data) {
+    EncoderRegistry *registry = (EncoderRegistry *)user_data;
+    gint64 start = g_get_monotonic_time();
+
+    for (gsize i = 0; i < G_N_ELEMENTS(registry->entries); i++) {
+        probe_encoder_capability(&registry->entries[i]);
+    }
+
+    g_mutex_lock(&registry->mutex);
+    registry->ready = TRUE;
+    g_cond_broadcast(&registry->cond);
+    g_mutex_unlock(&registry->mutex);
+
+    g_print("Encoder registry built in %.1f ms\n", (g_get_monotonic_time() - start) / 1000.0);
+    for (gsize i = 0; i < G_N_ELEMENTS(registry->entries); i++) {
+        const EncoderCapability *cap = &registry->entries[i];
+        if (cap->available) {
+            g_print("  %s: %s, formats %s, up to %dx%d@%dfps\n", cap->name,
+                    cap->ready_ok ? "usable" : "failed to open",
+                    cap->formats ? cap->formats : "unknown",
+                    cap->max_width, cap->max_height, cap->max_framerate);
+        }
+    }
+    return NULL;
+}
+
+// Probe every known encoder on a worker thread while the rest of startup continues
+static void encoder_registry_start(EncoderRegistry *registry) {
+    g_mutex_init(&registry->mutex);
+    g_cond_init(&registry->cond);
+    for (gsize i = 0; i < G_N_ELEMENTS(registry->entries); i++) {
+        registry->entries[i].name = known_encoders[i];
+    }
+    registry->thread = g_thread_new("encoder-probe", encoder_registry_thread, registry);
+}
+
+static void encoder_registry_wait(EncoderRegistry *registry) {
+    g_mutex_lock(&registry->mutex);
+    while (!registry->ready) {
+        g_cond_wait(&registry->cond, &registry->mutex);
+    }
+    g_mutex_unlock(&registry->mutex);
+}
+
+// Entries are immutable once probing finished; NULL for encoders outside the known list
+static const EncoderCapability* encoder_registry_lookup(EncoderRegistry *registry, const gchar *name) {
+    encoder_registry_wait(registry);
+    for (gsize i = 0; i < G_N_ELEMENTS(registry->entries); i++) {
+        if (strcmp(registry->entries[i].name, name) == 0) {
+            return &registry->entries[i];
+        }
+    }
+    return NULL;
+}
+
+static void encoder_registry_clear(EncoderRegistry *registry) {
+    if (!registry->thread) {
+        return;
+    }
+    g_thread_join(registry->thread);
+    registry->thread = NULL;
+    for (gsize i = 0; i < G_N_ELEMENTS(registry->entries); i++) {
+        g_free(registry->entries[i].formats);
+        registry->entries[i].formats = NULL;
+    }
+    g_cond_clear(&registry->cond);
+    g_mutex_clear(&registry->mutex);
+}
+
+// ==================== End of Encoder Registry ====================
+
+// ==================== Camera Monitor ====================
+
+static void camera_entry_free(gpointer ptr) {
+    CameraEntry *entry = (CameraEntry *)ptr;
+    gst_object_unref(entry->device);
+    g_free(entry->name);
+    g_free(entry->path);
+    g_free(entry->caps);
+    g_free(entry);
+}
+
+// Device node for V4L2 devices; libcamera cameras are addressed by their name
+static gchar* camera_device_path(GstDevice *device) {
+    static const gchar *path_keys[] = {"device.path", "api.v4l2.path", "object.path", NULL};
+    gchar *path = NULL;
+    GstStructure *props = gst_device_get_properties(device);
+    if (props) {
+        for (int i = 0; path_keys[i] && !path; i++) {
+            const gchar *value = gst_structure_get_string(props, path_keys[i]);
+            if (value && value[0] != '\0') {
+                path = g_strdup(value);
+            }
+        }
+        gst_structure_free(props);
+    }
+    return path ? path : gst_device_get_display_name(device);
+}
+
+// Called with cameras->mutex held. Returns the new entry, or NULL if the device is known.
+static CameraEntry* camera_table_add(CameraMonitor *cameras, GstDevice *device) {
+    for (guint i = 0; i < cameras->table->len; i++) {
+        CameraEntry *entry = g_ptr_array_index(cameras->table, i);
+        if (entry->device == device) {
+            return NULL;
+        }
+    }
+
+    CameraEntry *entry = g_new0(CameraEntry, 1);
+    entry->device = gst_object_ref(device);
+    entry->name = gst_device_get_display_name(device);
+    entry->path = camera_device_path(device);
+    GstCaps *caps = gst_device_get_caps(device);
+    entry->caps = caps ? gst_caps_to_string(caps) : g_strdup("");
+    if (caps) {
+        gst_caps_unref(caps);
+    }
+    g_ptr_array_add(cameras->table, entry);
+    return entry;
+}
+
+static void notify_camera_event(CustomData *data, gboolean added, const CameraEntry *entry) {
+    g_print("Camera %s: %s (%s)\n", added ? "added" : "removed", entry->name, entry->path);
+    if (data->grpc_server) {
+        grpc_camera_info_t info = {
+            .name = entry->name,
+            .path = entry->path,
+            .caps = entry->caps,
+        };
+        f1sh_grpc_server_notify_camera(data->grpc_server, added ? 1 : 0, &info);
+    }
+}
+
+// Runs on the device provider's thread for every hotplug message
+static GstBusSyncReply camera_monitor_bus_handler(GstBus *bus __attribute__((unused)), GstMessage *msg,
+                                                  gpointer user_data) {
+    CustomData *data = (CustomData *)user_data;
+    CameraMonitor *cameras = &data->cameras;
+    GstDevice *device = NULL;
+
+    switch (GST_MESSAGE_TYPE(msg)) {
+        case GST_MESSAGE_DEVICE_ADDED: {
+            gst_message_parse_device_added(msg, &device);
+            g_mutex_lock(&cameras->mutex);
+            CameraEntry *entry = camera_table_add(cameras, device);
+            g_mutex_unlock(&cameras->mutex);
+            // Entries are only freed on removal, which is delivered on this same thread
+            if (entry) {
+                notify_camera_event(data, TRUE, entry);
+            }
+            break;
+        }
+        case GST_MESSAGE_DEVICE_REMOVED: {
+            gst_message_parse_device_removed(msg, &device);
+            CameraEntry *removed = NULL;
+            g_mutex_lock(&cameras->mutex);
+            for (guint i = 0; i < cameras->table->len; i++) {
+                CameraEntry *entry = g_ptr_array_index(cameras->table, i);
+                if (entry->device == device) {
+                    removed = g_ptr_array_steal_index(cameras->table, i);
+                    break;
+                }
+            }
+            g_mutex_unlock(&cameras->mutex);
+            if (removed) {
+                notify_camera_event(data, FALSE, removed);
+                camera_entry_free(removed);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+
+    if (device) {
+        gst_object_unref(device);
+    }
+    return GST_BUS_DROP;
+}
+
+// The table exists before the gRPC server starts, so listings never race its creation
+static void init_camera_table(CameraMonitor *cameras) {
+    g_mutex_init(&cameras->mutex);
+    cameras->table = g_ptr_array_new_with_free_func(camera_entry_free);
+}
+
+// Keep one device monitor running for the lifetime of the process so camera listings
+// are answered from memory and hotplug can be pushed to clients. Started after the
+// gRPC server so hotplug events always have somewhere to go.
+static gboolean start_camera_monitor(CustomData *data) {
+    CameraMonitor *cameras = &data->cameras;
+    cameras->monitor = gst_device_monitor_new();
+    GstCaps *caps = gst_caps_new_empty_simple("video/x-raw");
+    gst_device_monitor_add_filter(cameras->monitor, "Video/Source", caps);
+    gst_caps_unref(caps);
+
+    GstBus *bus = gst_device_monitor_get_bus(cameras->monitor);
+    gst_bus_set_sync_handler(bus, camera_monitor_bus_handler, data, NULL);
+    gst_object_unref(bus);
+
+    if (!gst_device_monitor_start(cameras->monitor)) {
+        g_printerr("Failed to start camera device monitor\n");
+        gst_object_unref(cameras->monitor);
+        cameras->monitor = NULL;
+        return FALSE;
+    }
+
+    // Providers without hotplug support only report devices when probed
+    GList *devices = gst_device_monitor_get_devices(cameras->monitor);
+    g_mutex_lock(&cameras->mutex);
+    for (GList *l = devices; l != NULL; l = l->next) {
+        camera_table_add(cameras, GST_DEVICE(l->data));
+    }
+    guint count = cameras->table->len;
+    g_mutex_unlock(&cameras->mutex);
+    g_list_free_full(devices, gst_object_unref);
+
+    g_print("Camera monitor started, %u camera(s) present\n", count);
+    return TRUE;
+}
+
+static void shutdown_camera_monitor(CustomData *data) {
+    CameraMonitor *cameras = &data->cameras;
+    if (!cameras->table) {
+        return;
+    }
+    if (cameras->monitor) {
+        gst_device_monitor_stop(cameras->monitor);
+        GstBus *bus = gst_device_monitor_get_bus(cameras->monitor);
+        gst_bus_set_sync_handler(bus, NULL, NULL, NULL);
+        gst_object_unref(bus);
+        gst_object_unref(cameras->monitor);
+        cameras->monitor = NULL;
+    }
+    g_ptr_array_free(cameras->table, TRUE);
+    cameras->table = NULL;
+    g_mutex_clear(&cameras->mutex);
+}
+
+// ==================== End of Camera Monitor ====================
+
+// ==================== gRPC Callback Implementations ====================
+
+// Copy the application config into a gRPC config structure (strings are duplicated)
+static void fill_grpc_config(const AppConfig *config, grpc_config_t *out) {
+    out->host = g_strdup(config->host);
+    out->port = config->port;
+    out->camera_name = g_strdup(config->camera_name);
+    out->encoder_type = g_strdup(config->encoder_type);
+    out->width = config->width;
+    out->height = config->height;
+    out->framerate = config->framerate;
+    out->source_type = g_strdup(config->source_type);
+    out->source_device = g_strdup(config->source_device);
+    out->test_pattern = g_strdup(config->test_pattern);
+    out->test_motion = g_strdup(config->test_motion);
+    out->capture_mode = g_strdup(config->capture_mode);
+    out->pixel_format = g_strdup(config->pixel_format);
+    out->live_renegotiate = config->live_renegotiate ? 1 : 0;
+    out->standby_swap = config->standby_swap ? 1 : 0;
+    out->rtcp = config->rtcp ? 1 : 0;
+    out->rtcp_port = config->rtcp_port;
+    out->bitrate_kbps = config->bitrate_kbps;
+    out->min_bitrate_kbps = config->min_bitrate_kbps;
+    out->max_bitrate_kbps = config->max_bitrate_kbps;
+    out->adaptive_bitrate = config->adaptive_bitrate ? 1 : 0;
+    out->fec = g_strdup(config->fec);
+    out->fec_percentage = config->fec_percentage;
+    out->rtx = config->rtx ? 1 : 0;
+    out->rtx_history_ms = config->rtx_history_ms;
+    out->tx_mode = g_strdup(config->tx_mode);
+    out->pacing_factor = config->pacing_factor;
+    out->pacing_max_delay_ms = config->pacing_max_delay_ms;
+    out->rtp_mtu = config->rtp_mtu;
+    out->rtp_aggregate = g_strdup(config->rtp_aggregate);
+    out->dscp = config->dscp;
+    out->socket_priority = config->socket_priority;
+    out->send_buffer_kb = config->send_buffer_kb;
+}
+
+// Health check callback
+static void grpc_health_cb(void* user_data, char** status_out) {
+    *status_out = strdup("healthy");
+}
+
+// Get stats callback
+static void grpc_get_stats_cb(void* user_data, grpc_stats_t* stats) {
+    CustomData *data = (CustomData*)user_data;
+    guint64 total_bytes, packets;
+    tx_counters_read(&data->stats.tx, &total_bytes, &packets);
+    stats->total_bytes = total_bytes;
+    stats->rtp_packets = packets;
+    stats->frame_count = atomic_load_explicit(&data->stats.encoded_frames, memory_order_relaxed);
+    stats->keyframes = atomic_load_explicit(&data->stats.keyframes, memory_order_relaxed);
+    stats->delta_frames = stats->frame_count >= stats->keyframes ? stats->frame_count - stats->keyframes : 0;
+    stats->encoded_bytes = atomic_load_explicit(&data->stats.encoded_bytes, memory_order_relaxed);
+    stats->fec_packets = atomic_load_explicit(&data->stats.fec_packets, memory_order_relaxed);
+    stats->fec_bytes = atomic_load_explicit(&data->stats.fec_bytes, memory_order_relaxed);
+    stats->rtx_requests = atomic_load_explicit(&data->stats.rtx_requests, memory_order_relaxed);
+    stats->rtx_packets = atomic_load_explicit(&data->stats.rtx_packets, memory_order_relaxed);
+    stats->rtx_bytes = atomic_load_explicit(&data->stats.rtx_bytes, memory_order_relaxed);
+    stats->tx_syscalls = atomic_load_explicit(&data->stats.tx_syscalls, memory_order_relaxed);
+    stats->tx_batches = atomic_load_explicit(&data->stats.tx_batches, memory_order_relaxed);
+    stats->tx_gso_sends = atomic_load_explicit(&data->stats.tx_gso_sends, memory_order_relaxed);
+    stats->tx_syscalls_per_frame = stats->frame_count ? (double)stats->tx_syscalls / stats->frame_count : 0.0;
+    stats->paced_packets = atomic_load_explicit(&data->stats.paced_packets, memory_order_relaxed);
+    stats->pacing_delay_avg_ms = stats->paced_packets
+        ? atomic_load_explicit(&data->stats.pacing_delay_usec, memory_order_relaxed) / 1000.0 / stats->paced_packets
+        : 0.0;
+    stats->pacing_delay_max_ms = atomic_load_explicit(&data->stats.pacing_delay_max_usec, memory_order_relaxed) / 1000.0;
+    stats->pacing_overruns = atomic_load_explicit(&data->stats.pacing_overruns, memory_order_relaxed);
+    stats->pacing_queue_depth = MAX(atomic_load_explicit(&data->stats.pacing_queued, memory_order_relaxed), 0);
+    stats->pacing_queue_max = atomic_load_explicit(&data->stats.pacing_queued_max, memory_order_relaxed);
+    stats->tx_enobufs = atomic_load_explicit(&data->stats.tx_enobufs, memory_order_relaxed);
+    stats->rtp_mtu = MAX(atomic_load_explicit(&data->stats.rtp_mtu, memory_order_relaxed), 0);
+    stats->rtp_packets_per_frame = stats->frame_count ? (double)stats->rtp_packets / stats->frame_count : 0.0;
+    stats->rtp_overhead_ratio = stats->encoded_bytes && stats->total_bytes > stats->encoded_bytes
+        ? (double)(stats->total_bytes - stats->encoded_bytes) / stats->encoded_bytes : 0.0;
+    stats->last_destination_switch_ms =
+        atomic_load_explicit(&data->stats.last_switch_usec, memory_order_relaxed) / 1000.0;
+    stats->dmabuf_buffers = atomic_load_explicit(&data->stats.dmabuf_buffers, memory_order_relaxed);
+    stats->system_buffers = atomic_load_explicit(&data->stats.system_buffers, memory_order_relaxed);
+
+    const FrameAnalytics *analytics = &data->analytics;
+    guint64 idr_frames = atomic_load_explicit(&analytics->types[FRAME_TYPE_IDR].frames, memory_order_relaxed);
+    guint64 p_frames = atomic_load_explicit(&analytics->types[FRAME_TYPE_P].frames, memory_order_relaxed);
+    stats->avg_idr_bytes = idr_frames
+        ? atomic_load_explicit(&analytics->types[FRAME_TYPE_IDR].bytes, memory_order_relaxed) / idr_frames : 0;
+    stats->max_idr_bytes = atomic_load_explicit(&analytics->types[FRAME_TYPE_IDR].max_bytes, memory_order_relaxed);
+    stats->avg_p_bytes = p_frames
+        ? atomic_load_explicit(&analytics->types[FRAME_TYPE_P].bytes, memory_order_relaxed) / p_frames : 0;
+    stats->last_gop_length = atomic_load_explicit(&analytics->last_gop, memory_order_relaxed);
+    stats->sps_count = atomic_load_explicit(&analytics->sps, memory_order_relaxed);
+    stats->pps_count = atomic_load_explicit(&analytics->pps, memory_order_relaxed);
+
+    g_mutex_lock(&data->stats.stats_mutex);
+
+    // Windowed rates are refreshed once a second by sample_stream_rates()
+    stats->bitrate = data->stats.current_bitrate;
+    stats->bitrate_5s = data->stats.bitrate_5s;
+    stats->bitrate_60s = data->stats.bitrate_60s;
+    stats->bitrate_ewma = data->stats.bitrate_ewma;
+    stats->packet_rate = data->stats.packet_rate_1s;
+    stats->frame_rate = data->stats.frame_rate_1s;
+    stats->frame_rate_5s = data->stats.frame_rate_5s;
+
+    stats->zero_copy_active = data->stats.zero_copy_active ? 1 : 0;
+    stats->dmabuf_fallbacks = data->stats.dmabuf_fallbacks;
+    stats->conversion_in_path = data->stats.conversion_in_path ? 1 : 0;
+    g_strlcpy(stats->negotiated_format, data->stats.negotiated_format, sizeof(stats->negotiated_format));
+    stats->renegotiations = data->stats.renegotiations;
+    stats->renegotiation_fallbacks = data->stats.renegotiation_fallbacks;
+    stats->last_renegotiation_ms = data->stats.last_renegotiation_ms;
+    stats->restarts = data->stats.restarts;
+    stats->last_restart_ms = data->stats.last_restart_ms;
+    stats->last_release_wait_ms = data->stats.last_release_wait_ms;
+    stats->standby_swaps = data->stats.standby_swaps;
+    stats->standby_swap_fallbacks = data->stats.standby_swap_fallbacks;
+    stats->last_standby_swap_ms = data->stats.last_standby_swap_ms;
+    stats->destination_switches = data->stats.destination_switches;
+    stats->kernel_sndbuf_errors = data->stats.kernel_sndbuf_errors;
+    stats->target_bitrate_kbps = data->stats.target_bitrate_kbps;
+    stats->bitrate_increases = data->stats.bitrate_increases;
+    stats->bitrate_decreases = data->stats.bitrate_decreases;
+    g_strlcpy(stats->bitrate_decision, data->stats.bitrate_decision, sizeof(stats->bitrate_decision));
+    stats->feedback_loss = data->stats.feedback_loss;
+    stats->feedback_rtt_ms = data->stats.feedback_rtt_ms;
+    stats->num_receivers = MIN(data->stats.num_receivers, GRPC_MAX_RECEIVERS);
+    for (int i = 0; i < stats->num_receivers; i++) {
+        const ReceiverReport *src = &data->stats.receivers[i];
+        grpc_receiver_stats_t *dst = &stats->receivers[i];
+        dst->ssrc = src->ssrc;
+        g_strlcpy(dst->address, src->address, sizeof(dst->address));
+        dst->fraction_lost = src->fraction_lost;
+        dst->packets_lost = src->packets_lost;
+        dst->jitter_ms = src->jitter_ms;
+        dst->rtt_ms = src->rtt_ms;
+    }
+
+    g_mutex_unlock(&data->stats.stats_mutex);
+}
+
+// Get config callback
+static void grpc_get_config_cb(void* user_data, grpc_config_t* config) {
+    CustomData *data = (CustomData*)user_data;
+    g_mutex_lock(&data->state_mutex);
+
+    fill_grpc_config(&data->config, config);
+
+    g_mutex_unlock(&data->state_mutex);
+}
+
+// Forget which negotiation fallbacks were taken, so a new source/encoder/format gets a fresh try
+static void reset_negotiation_fallbacks(CustomData *data) {
+    data->dmabuf_import_failed = FALSE;
+    data->convert_forced = FALSE;
+}
+
+// Update config callback
+static int grpc_update_config_cb(void* user_data, const grpc_config_update_t* update,
+                                  grpc_config_t* new_config, char** error_msg) {
+    CustomData *data = (CustomData*)user_data;
+    gboolean needs_rebuild = FALSE;
+    gboolean needs_resize = FALSE;
+    gboolean needs_host_update = FALSE;
+    gboolean needs_port_update = FALSE;
+    gboolean needs_encoder_swap = FALSE;
+    gboolean needs_bitrate_update = FALSE;
+    gboolean needs_pacing_update = FALSE;
+    gboolean needs_packetization_update = FALSE;
+    gboolean needs_qos_update = FALSE;
+
+    if (update->has_source_type && !is_valid_source_type(update->source_type)) {
+        *error_msg = g_strdup_printf("Unknown source type '%s' (expected libcamera, v4l2, videotest or file)",
+                                     update->source_type ? update->source_type : "");
+        return 0;
+    }
+
+    if (update->has_test_pattern && !is_valid_videotest_nick("pattern", update->test_pattern)) {
+        *error_msg = g_strdup_printf("Unknown test pattern '%s' (expected a videotestsrc pattern nick such as smpte or ball)",
+                                     update->test_pattern ? update->test_pattern : "");
+        return 0;
+    }
+
+    if (update->has_test_motion && !is_valid_videotest_nick("motion", update->test_motion)) {
+        *error_msg = g_strdup_printf("Unknown test motion '%s' (expected wavy, sweep or hsweep)",
+                                     update->test_motion ? update->test_motion : "");
+        return 0;
+    }
+
+    if (update->has_capture_mode && !is_valid_capture_mode(update->capture_mode)) {
+        *error_msg = g_strdup_printf("Unknown capture mode '%s' (expected auto, dmabuf or system)",
+                                     update->capture_mode ? update->capture_mode : "");
+        return 0;
+    }
+
+    if (update->has_fec && !is_valid_fec_mode(update->fec)) {
+        *error_msg = g_strdup_printf("Unknown FEC mode '%s' (expected none, ulpfec or st2022)",
+                                     update->fec ? update->fec : "");
+        return 0;
+    }
+
+    if (update->has_fec_percentage && (update->fec_percentage <= 0 || update->fec_percentage > 100)) {
+        *error_msg = strdup("fec_percentage must be between 1 and 100");
+        return 0;
+    }
+
+    if (update->has_tx_mode && !is_valid_tx_mode(update->tx_mode)) {
+        *error_msg = g_strdup_printf("Unknown tx_mode '%s' (expected udpsink or batched)",
+                                     update->tx_mode ? update->tx_mode : "");
+        return 0;
+    }
+
+    if (update->has_rtp_mtu && !is_valid_rtp_mtu(update->rtp_mtu)) {
+        *error_msg = strdup("rtp_mtu must be 0 (per interface) or between 256 and 9000");
+        return 0;
+    }
+
+    if (update->has_rtp_aggregate && !is_valid_rtp_aggregate(update->rtp_aggregate)) {
+        *error_msg = g_strdup_printf("Unknown rtp_aggregate '%s' (expected none, zero-latency or max-stap)",
+                                     update->rtp_aggregate ? update->rtp_aggregate : "");
+        return 0;
+    }
+
+    if (update->has_dscp && (update->dscp < 0 || update->dscp > MAX_DSCP)) {
+        *error_msg = strdup("dscp must be between 0 and 63");
+        return 0;
+    }
+
+    if (update->has_socket_priority && (update->socket_priority < 0 || update->socket_priority > MAX_SOCKET_PRIORITY)) {
+        *error_msg = strdup("socket_priority must be between 0 and 6");
+        return 0;
+    }
+
+    if (update->has_send_buffer_kb && (update->send_buffer_kb < 0 || update->send_buffer_kb > MAX_SEND_BUFFER_KB)) {
+        *error_msg = strdup("send_buffer_kb must be between 0 and 65536");
+        return 0;
+    }
+
+    if (update->has_pacing_factor && update->pacing_factor != 0.0 && update->pacing_factor < 1.0) {
+        *error_msg = strdup("pacing_factor must be 0 (off) or at least 1.0");
+        return 0;
+    }
+
+    if (update->has_pacing_max_delay_ms && (update->pacing_max_delay_ms <= 0 || update->pacing_max_delay_ms > 1000)) {
+        *error_msg = strdup("pacing_max_delay_ms must be between 1 and 1000");
+        return 0;
+    }
+
+    if (update->has_rtx_history_ms && update->rtx_history_ms <= 0) {
+        *error_msg = strdup("rtx_history_ms must be positive");
+        return 0;
+    }
+
+    if (update->has_port && (update->port <= 0 || update->port > 65535)) {
+        *error_msg = strdup("port must be between 1 and 65535");
+        return 0;
+    }
+
+    if (update->has_rtcp_port && (update->rtcp_port < 0 || update->rtcp_port > 65535)) {
+        *error_msg = strdup("rtcp_port must be between 0 (port + 1) and 65535");
+        return 0;
+    }
+
+    if ((update->has_bitrate_kbps && update->bitrate_kbps <= 0) ||
+        (update->has_min_bitrate_kbps && update->min_bitrate_kbps <= 0) ||
+        (update->has_max_bitrate_kbps && update->max_bitrate_kbps <= 0)) {
+        *error_msg = strdup("Bitrates must be positive");
+        return 0;
+    }
+
+    g_mutex_lock(&data->state_mutex);
+
+    gint min_kbps = update->has_min_bitrate_kbps ? update->min_bitrate_kbps : data->config.min_bitrate_kbps;
+    gint max_kbps = update->has_max_bitrate_kbps ? update->max_bitrate_kbps : data->config.max_bitrate_kbps;
+    if (min_kbps > max_kbps) {
+        *error_msg = g_strdup_printf("min_bitrate_kbps %d is above max_bitrate_kbps %d", min_kbps, max_kbps);
+        g_mutex_unlock(&data->state_mutex);
+        return 0;
+    }
+
+    // NACKs arrive over RTCP, so retransmission is only possible with the RTCP session
+    gboolean rtcp_after = update->has_rtcp ? (update->rtcp ? TRUE : FALSE) : data->config.rtcp;
+    gboolean rtx_after = update->has_rtx ? (update->rtx ? TRUE : FALSE) : data->config.rtx;
+    if (rtx_after && !rtcp_after) {
+        *error_msg = strdup("rtx requires rtcp to be enabled");
+        g_mutex_unlock(&data->state_mutex);
+        return 0;
+    }
+
+    // RTCP on port + 1 needs that port to exist
+    gint port_after = update->has_port ? update->port : data->config.port;
+    gint rtcp_port_after = update->has_rtcp_port ? update->rtcp_port : data->config.rtcp_port;
+    if (rtcp_after && rtcp_port_after == 0 && port_after >= 65535) {
+        *error_msg = strdup("port 65535 leaves no port + 1 for RTCP; set rtcp_port");
+        g_mutex_unlock(&data->state_mutex);
+        return 0;
+    }
+
+    // ST 2022-1 column FEC goes to port + 2
+    const gchar *fec_after = update->has_fec ? update->fec : data->config.fec;
+    if (g_strcmp0(fec_after, "st2022") == 0 && port_after > 65535 - ST2022_FEC_PORT_OFFSET) {
+        *error_msg = g_strdup_printf("port %d leaves no port + %d for st2022 FEC", port_after, ST2022_FEC_PORT_OFFSET);
+        g_mutex_unlock(&data->state_mutex);
+        return 0;
+    }
+
+    // Apply updates
+    gchar *old_host = g_strdup(data->config.host);
+    gint old_port = data->config.port;
     if (update->has_host && update->host) {
         g_free(data->config.host);
         data->config.host = g_strdup(update->host);
@@ -1447,235 +3045,2833 @@ static int grpc_update_config_cb(void* user_data, const grpc_config_update_t* up
     if (update->has_encoder_type && update->encoder_type) {
         g_free(data->config.encoder_type);
         data->config.encoder_type = g_strdup(update->encoder_type);
-        needs_rebuild = TRUE;
+        reset_negotiation_fallbacks(data);
+        needs_encoder_swap = TRUE;
     }
     if (update->has_width) {
         data->config.width = update->width;
-        needs_rebuild = TRUE;
+        needs_resize = TRUE;
     }
     if (update->has_height) {
         data->config.height = update->height;
+        needs_resize = TRUE;
+    }
+    if (update->has_framerate) {
+        data->config.framerate = update->framerate;
+        needs_resize = TRUE;
+    }
+    if (update->has_live_renegotiate) {
+        data->config.live_renegotiate = update->live_renegotiate ? TRUE : FALSE;
+    }
+    if (update->has_standby_swap && (update->standby_swap ? TRUE : FALSE) != data->config.standby_swap) {
+        // The capture tee only exists in pipelines built with standby swapping enabled
+        data->config.standby_swap = update->standby_swap ? TRUE : FALSE;
+        needs_rebuild = TRUE;
+    }
+    if (update->has_bitrate_kbps || update->has_min_bitrate_kbps || update->has_max_bitrate_kbps ||
+        update->has_adaptive_bitrate) {
+        if (update->has_bitrate_kbps) {
+            data->config.bitrate_kbps = update->bitrate_kbps;
+        }
+        data->config.min_bitrate_kbps = min_kbps;
+        data->config.max_bitrate_kbps = max_kbps;
+        if (update->has_adaptive_bitrate) {
+            data->config.adaptive_bitrate = update->adaptive_bitrate ? TRUE : FALSE;
+        }
+        needs_bitrate_update = TRUE;
+    }
+    if (update->has_fec && update->fec && strcmp(update->fec, data->config.fec) != 0) {
+        g_free(data->config.fec);
+        data->config.fec = g_strdup(update->fec);
+        needs_rebuild = TRUE;
+    }
+    if (update->has_fec_percentage && update->fec_percentage != data->config.fec_percentage) {
+        data->config.fec_percentage = update->fec_percentage;
+        needs_rebuild = strcmp(data->config.fec, "none") != 0 || needs_rebuild;
+    }
+    if (update->has_rtcp && (update->rtcp ? TRUE : FALSE) != data->config.rtcp) {
+        data->config.rtcp = update->rtcp ? TRUE : FALSE;
+        needs_rebuild = TRUE;
+    }
+    // The pace queue is only in the pipeline while pacing is on; rate and delay change live
+    if (update->has_pacing_factor && update->pacing_factor != data->config.pacing_factor) {
+        needs_rebuild = (update->pacing_factor == 0.0) != (data->config.pacing_factor == 0.0) || needs_rebuild;
+        data->config.pacing_factor = update->pacing_factor;
+        needs_pacing_update = TRUE;
+    }
+    if (update->has_pacing_max_delay_ms && update->pacing_max_delay_ms != data->config.pacing_max_delay_ms) {
+        data->config.pacing_max_delay_ms = update->pacing_max_delay_ms;
+        needs_pacing_update = TRUE;
+    }
+    // Socket options are set on the running sinks' sockets. Priority and buffer size 0 mean
+    // the kernel's default, which only a fresh socket gets back, so going to 0 rebuilds.
+    if (update->has_dscp && update->dscp != data->config.dscp) {
+        data->config.dscp = update->dscp;
+        needs_qos_update = TRUE;
+    }
+    if (update->has_socket_priority && update->socket_priority != data->config.socket_priority) {
+        needs_rebuild = update->socket_priority == 0 || needs_rebuild;
+        data->config.socket_priority = update->socket_priority;
+        needs_qos_update = TRUE;
+    }
+    if (update->has_send_buffer_kb && update->send_buffer_kb != data->config.send_buffer_kb) {
+        needs_rebuild = update->send_buffer_kb == 0 || needs_rebuild;
+        data->config.send_buffer_kb = update->send_buffer_kb;
+        needs_qos_update = TRUE;
+    }
+    // Packetization is a payloader property and changes on the running pipeline
+    if (update->has_rtp_mtu && update->rtp_mtu != data->config.rtp_mtu) {
+        data->config.rtp_mtu = update->rtp_mtu;
+        needs_packetization_update = TRUE;
+    }
+    if (update->has_rtp_aggregate && update->rtp_aggregate &&
+        strcmp(update->rtp_aggregate, data->config.rtp_aggregate) != 0) {
+        g_free(data->config.rtp_aggregate);
+        data->config.rtp_aggregate = g_strdup(update->rtp_aggregate);
+        needs_packetization_update = TRUE;
+    }
+    if (update->has_tx_mode && update->tx_mode && strcmp(update->tx_mode, data->config.tx_mode) != 0) {
+        g_free(data->config.tx_mode);
+        data->config.tx_mode = g_strdup(update->tx_mode);
+        needs_rebuild = TRUE;
+    }
+    if (update->has_rtx && (update->rtx ? TRUE : FALSE) != data->config.rtx) {
+        data->config.rtx = update->rtx ? TRUE : FALSE;
+        needs_rebuild = TRUE;
+    }
+    if (update->has_rtx_history_ms && update->rtx_history_ms != data->config.rtx_history_ms) {
+        data->config.rtx_history_ms = update->rtx_history_ms;
+        needs_rebuild = data->config.rtx || needs_rebuild;
+    }
+    if (update->has_rtcp_port && update->rtcp_port != data->config.rtcp_port) {
+        data->config.rtcp_port = update->rtcp_port;
+        needs_rebuild = data->config.rtcp || needs_rebuild;
+    }
+    if (update->has_source_type && update->source_type) {
+        g_free(data->config.source_type);
+        data->config.source_type = g_strdup(update->source_type);
+        reset_negotiation_fallbacks(data);
+        needs_rebuild = TRUE;
+    }
+    if (update->has_source_device && update->source_device) {
+        g_free(data->config.source_device);
+        data->config.source_device = g_strdup(update->source_device);
         needs_rebuild = TRUE;
     }
-    if (update->has_framerate) {
-        data->config.framerate = update->framerate;
-        needs_rebuild = TRUE;
+    if (update->has_test_pattern && update->test_pattern) {
+        g_free(data->config.test_pattern);
+        data->config.test_pattern = g_strdup(update->test_pattern);
+        needs_rebuild = TRUE;
+    }
+    if (update->has_test_motion && update->test_motion) {
+        g_free(data->config.test_motion);
+        data->config.test_motion = g_strdup(update->test_motion);
+        needs_rebuild = TRUE;
+    }
+    if (update->has_capture_mode && update->capture_mode) {
+        g_free(data->config.capture_mode);
+        data->config.capture_mode = g_strdup(update->capture_mode);
+        reset_negotiation_fallbacks(data);
+        needs_rebuild = TRUE;
+    }
+    if (update->has_pixel_format && update->pixel_format) {
+        g_free(data->config.pixel_format);
+        data->config.pixel_format = g_strdup(update->pixel_format[0] != '\0' ? update->pixel_format
+                                                                              : DEFAULT_PIXEL_FORMAT);
+        reset_negotiation_fallbacks(data);
+        needs_rebuild = TRUE;
+    }
+
+    // Save config
+    if (!save_config_to_file(&data->config, data->config_file_path)) {
+        *error_msg = strdup("Failed to save configuration");
+        g_mutex_unlock(&data->state_mutex);
+        g_free(old_host);
+        return 0;
+    }
+
+    // An encoder change alone can be made on a standby branch while the old one keeps streaming.
+    // rtpbin has a single send session, so with RTCP on the encoder is swapped by a rebuild.
+    if (needs_encoder_swap && !needs_rebuild &&
+        !(data->config.standby_swap && data->active_branch && data->active_branch->tee_pad &&
+          !data->rtcp.rtpbin)) {
+        needs_rebuild = TRUE;
+    }
+
+    // Retarget the running sinks if nothing else needs a rebuild
+    if ((needs_host_update || needs_port_update) && !needs_rebuild &&
+        !switch_destination(data, old_host, old_port)) {
+        needs_rebuild = TRUE;
+    }
+    g_free(old_host);
+
+    // Bitrate changes are applied to the running encoder; a rebuild picks them up anyway
+    if (needs_bitrate_update && !needs_rebuild) {
+        guint target = data->config.adaptive_bitrate && update->has_bitrate_kbps == 0
+            ? data->bitrate.target_kbps : (guint)data->config.bitrate_kbps;
+        apply_target_bitrate(data, target, "config");
+    }
+    if (needs_pacing_update && !needs_rebuild) {
+        update_pacing(data);
+    }
+    if (needs_packetization_update && !needs_rebuild) {
+        update_packetization(data);
+    }
+    if (needs_qos_update && !needs_rebuild) {
+        apply_socket_qos(data);
+    }
+
+    // Return new config
+    fill_grpc_config(&data->config, new_config);
+
+    if (needs_rebuild) {
+        data->pipeline_is_restarting = TRUE;
+    } else {
+        if (needs_encoder_swap) {
+            data->pipeline_needs_branch_swap = TRUE;
+        }
+        if (needs_resize) {
+            request_resolution_change(data);
+        }
+    }
+
+    g_mutex_unlock(&data->state_mutex);
+    return 1;
+}
+
+// Swap resolution callback
+static int grpc_swap_resolution_cb(void* user_data, int swap, grpc_config_t* new_config,
+                                    char** error_msg) {
+    CustomData *data = (CustomData*)user_data;
+    gboolean persisted = FALSE;
+
+    if (!swap_config_resolution(data, swap, &persisted)) {
+        *error_msg = strdup("Failed to set resolution");
+        return 0;
+    }
+
+    g_mutex_lock(&data->state_mutex);
+    fill_grpc_config(&data->config, new_config);
+    g_mutex_unlock(&data->state_mutex);
+
+    return 1;
+}
+
+// Update host callback
+static int grpc_update_host_cb(void* user_data, const char* host, char** error_msg) {
+    CustomData *data = (CustomData*)user_data;
+
+    g_mutex_lock(&data->state_mutex);
+    gchar *old_host = data->config.host;
+    data->config.host = g_strdup(host);
+
+    if (!save_config_to_file(&data->config, data->config_file_path)) {
+        *error_msg = strdup("Failed to save configuration");
+        g_mutex_unlock(&data->state_mutex);
+        g_free(old_host);
+        return 0;
+    }
+
+    if (!switch_destination(data, old_host, data->config.port)) {
+        data->pipeline_is_restarting = TRUE;
+    }
+
+    g_mutex_unlock(&data->state_mutex);
+    g_free(old_host);
+    return 1;
+}
+
+// Get available devices callback
+static void grpc_get_devices_cb(void* user_data, grpc_devices_t* devices) {
+    CustomData *data = (CustomData*)user_data;
+
+    // List cameras from the device monitor's table
+    CameraMonitor *cameras = &data->cameras;
+    g_mutex_lock(&cameras->mutex);
+    devices->num_cameras = cameras->table->len;
+    devices->cameras = malloc(sizeof(grpc_camera_info_t) * devices->num_cameras);
+    for (guint i = 0; i < cameras->table->len; i++) {
+        const CameraEntry *entry = g_ptr_array_index(cameras->table, i);
+        devices->cameras[i].name = strdup(entry->name ? entry->name : "Unknown");
+        devices->cameras[i].path = strdup(entry->path ? entry->path : "");
+        devices->cameras[i].caps = strdup(entry->caps ? entry->caps : "");
+    }
+    g_mutex_unlock(&cameras->mutex);
+
+    // List installed encoders from the startup probe
+    EncoderRegistry *registry = &data->encoders;
+    encoder_registry_wait(registry);
+
+    int encoder_count = 0;
+    for (gsize j = 0; j < G_N_ELEMENTS(registry->entries); j++) {
+        if (registry->entries[j].available) {
+            encoder_count++;
+        }
+    }
+
+    devices->num_encoders = encoder_count;
+    devices->encoders = malloc(sizeof(grpc_encoder_info_t) * devices->num_encoders);
+
+    int enc_idx = 0;
+    for (gsize j = 0; j < G_N_ELEMENTS(registry->entries); j++) {
+        const EncoderCapability *cap = &registry->entries[j];
+        if (cap->available) {
+            devices->encoders[enc_idx].name = strdup(cap->name);
+            devices->encoders[enc_idx].available = 1;
+            devices->encoders[enc_idx].usable = cap->ready_ok ? 1 : 0;
+            devices->encoders[enc_idx].formats = strdup(cap->formats ? cap->formats : "");
+            devices->encoders[enc_idx].max_width = cap->max_width;
+            devices->encoders[enc_idx].max_height = cap->max_height;
+            devices->encoders[enc_idx].max_framerate = cap->max_framerate;
+            enc_idx++;
+        }
+    }
+}
+
+// Latency breakdown callback
+static void grpc_get_latency_cb(void* user_data, int reset, grpc_latency_t* latency) {
+    CustomData *data = (CustomData*)user_data;
+    guint counts[LATENCY_BUCKETS];
+
+    latency->num_stages = 0;
+    g_mutex_lock(&data->state_mutex);
+    for (int i = 0; i < LATENCY_STAGE_COUNT; i++) {
+        LatencyStage *stage = &data->latency[i];
+        if (stage->element[0] == '\0') {
+            continue;
+        }
+
+        guint64 total = 0;
+        for (int b = 0; b < LATENCY_BUCKETS; b++) {
+            counts[b] = atomic_load_explicit(&stage->buckets[b], memory_order_relaxed);
+            total += counts[b];
+        }
+
+        grpc_latency_stage_t *out = &latency->stages[latency->num_stages++];
+        g_strlcpy(out->stage, latency_stage_names[i], sizeof(out->stage));
+        g_strlcpy(out->element, stage->element, sizeof(out->element));
+        out->samples = total;
+        out->p50_ms = latency_percentile_ms(counts, total, 0.50);
+        out->p95_ms = latency_percentile_ms(counts, total, 0.95);
+        out->p99_ms = latency_percentile_ms(counts, total, 0.99);
+        out->max_ms = atomic_load_explicit(&stage->max_usec, memory_order_relaxed) / 1000.0;
+    }
+    if (reset) {
+        reset_latency_histograms(data);
+    }
+    g_mutex_unlock(&data->state_mutex);
+}
+
+// Frame analytics callback
+static void grpc_get_frame_analytics_cb(void* user_data, grpc_frame_analytics_t* out) {
+    CustomData *data = (CustomData*)user_data;
+    const FrameAnalytics *analytics = &data->analytics;
+
+    out->num_types = 0;
+    for (int t = 0; t < FRAME_TYPE_COUNT && t < GRPC_MAX_FRAME_TYPES; t++) {
+        const FrameSizeStats *src = &analytics->types[t];
+        grpc_frame_type_stats_t *dst = &out->types[out->num_types++];
+        g_strlcpy(dst->type, frame_type_names[t], sizeof(dst->type));
+        dst->frames = atomic_load_explicit(&src->frames, memory_order_relaxed);
+        dst->bytes = atomic_load_explicit(&src->bytes, memory_order_relaxed);
+        dst->max_bytes = atomic_load_explicit(&src->max_bytes, memory_order_relaxed);
+        for (int b = 0; b < FRAME_SIZE_BUCKETS && b < GRPC_FRAME_SIZE_BUCKETS; b++) {
+            dst->buckets[b] = atomic_load_explicit(&src->buckets[b], memory_order_relaxed);
+        }
+    }
+
+    out->gops = atomic_load_explicit(&analytics->gops, memory_order_relaxed);
+    out->last_gop_length = atomic_load_explicit(&analytics->last_gop, memory_order_relaxed);
+    out->min_gop_length = atomic_load_explicit(&analytics->min_gop, memory_order_relaxed);
+    out->max_gop_length = atomic_load_explicit(&analytics->max_gop, memory_order_relaxed);
+    out->avg_gop_length = out->gops
+        ? (gdouble)atomic_load_explicit(&analytics->gop_frames, memory_order_relaxed) / out->gops : 0.0;
+    out->sps_count = atomic_load_explicit(&analytics->sps, memory_order_relaxed);
+    out->pps_count = atomic_load_explicit(&analytics->pps, memory_order_relaxed);
+}
+
+// Receiver feedback callback, input to the adaptive bitrate controller
+static uint32_t grpc_report_feedback_cb(void* user_data, double fraction_lost, double rtt_ms) {
+    CustomData *data = (CustomData*)user_data;
+    g_mutex_lock(&data->state_mutex);
+    data->bitrate.rpc_loss = CLAMP(fraction_lost, 0.0, 1.0);
+    data->bitrate.rpc_rtt_ms = MAX(rtt_ms, 0.0);
+    data->bitrate.rpc_received_at = g_get_monotonic_time();
+    uint32_t target_kbps = data->bitrate.target_kbps;
+    g_mutex_unlock(&data->state_mutex);
+    return target_kbps;
+}
+
+static gboolean is_valid_destination(const char *host, int port, char **error_msg) {
+    if (!host || host[0] == '\0') {
+        *error_msg = strdup("Destination host must not be empty");
+        return FALSE;
+    }
+    if (port <= 0 || port > 65535) {
+        *error_msg = g_strdup_printf("Invalid destination port %d", port);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// Add destination callback: one more receiver on the running media sink, no rebuild
+static int grpc_add_destination_cb(void* user_data, const char* host, int port, char** error_msg) {
+    CustomData *data = (CustomData*)user_data;
+
+    if (!is_valid_destination(host, port, error_msg)) {
+        return 0;
+    }
+
+    g_mutex_lock(&data->state_mutex);
+    if ((port == data->config.port && g_ascii_strcasecmp(host, data->config.host) == 0) ||
+        find_destination(data, host, port) >= 0) {
+        *error_msg = g_strdup_printf("%s:%d is already a destination", host, port);
+        g_mutex_unlock(&data->state_mutex);
+        return 0;
+    }
+    if (data->destinations->len >= MAX_DESTINATIONS) {
+        *error_msg = g_strdup_printf("At most %d extra destinations are supported", MAX_DESTINATIONS);
+        g_mutex_unlock(&data->state_mutex);
+        return 0;
+    }
+
+    Destination *destination = g_new0(Destination, 1);
+    destination->host = g_strdup(host);
+    destination->port = port;
+    g_ptr_array_add(data->destinations, destination);
+    update_sink_destination(data, "add", host, port);
+    g_mutex_unlock(&data->state_mutex);
+
+    g_print("Added destination %s:%d\n", host, port);
+    return 1;
+}
+
+// Remove destination callback. The primary destination is changed with UpdateHost/UpdateConfig.
+static int grpc_remove_destination_cb(void* user_data, const char* host, int port, char** error_msg) {
+    CustomData *data = (CustomData*)user_data;
+
+    if (!is_valid_destination(host, port, error_msg)) {
+        return 0;
+    }
+
+    g_mutex_lock(&data->state_mutex);
+    gint index = find_destination(data, host, port);
+    if (index < 0) {
+        *error_msg = g_strdup_printf("%s:%d is not an extra destination", host, port);
+        g_mutex_unlock(&data->state_mutex);
+        return 0;
+    }
+    update_sink_destination(data, "remove", host, port);
+    g_ptr_array_remove_index(data->destinations, (guint)index);
+    g_mutex_unlock(&data->state_mutex);
+
+    g_print("Removed destination %s:%d\n", host, port);
+    return 1;
+}
+
+static void fill_destination(EncodeBranch *branch, const gchar *host, gint port, gboolean primary,
+                             grpc_destination_t *out) {
+    g_strlcpy(out->host, host ? host : "", sizeof(out->host));
+    out->port = port;
+    out->primary = primary ? 1 : 0;
+    if (!branch) {
+        return;
+    }
+    if (branch->tx) {
+        batch_sender_get_stats(branch->tx, host, port, &out->bytes_sent, &out->packets_sent);
+        return;
+    }
+
+    GstElement *sink = branch->sink;
+
+    GstStructure *stats = NULL;
+    g_signal_emit_by_name(sink, "get-stats", host, port, &stats);
+    if (stats) {
+        guint64 value = 0;
+        if (gst_structure_get_uint64(stats, "bytes-sent", &value)) {
+            out->bytes_sent = value;
+        }
+        if (gst_structure_get_uint64(stats, "packets-sent", &value)) {
+            out->packets_sent = value;
+        }
+        gst_structure_free(stats);
+    }
+}
+
+// List destinations callback: primary first, counters from the sink feeding the network
+static void grpc_list_destinations_cb(void* user_data, grpc_destinations_t* out) {
+    CustomData *data = (CustomData*)user_data;
+
+    g_mutex_lock(&data->state_mutex);
+    EncodeBranch *branch = data->active_branch;
+    fill_destination(branch, data->config.host, data->config.port, TRUE, &out->destinations[0]);
+    out->num_destinations = 1;
+    for (guint i = 0; i < data->destinations->len && out->num_destinations < GRPC_MAX_DESTINATIONS; i++) {
+        const Destination *destination = g_ptr_array_index(data->destinations, i);
+        fill_destination(branch, destination->host, destination->port, FALSE,
+                         &out->destinations[out->num_destinations++]);
+    }
+    g_mutex_unlock(&data->state_mutex);
+}
+
+// ==================== End of gRPC Callbacks ====================
+
+// ==================== Metrics Endpoint ====================
+
+static void metrics_appendf(MetricsServer *metrics, const gchar *format, ...) G_GNUC_PRINTF(2, 3);
+
+static void metrics_appendf(MetricsServer *metrics, const gchar *format, ...) {
+    if (metrics->truncated) {
+        return;
+    }
+    gsize remaining = METRICS_BUFFER_SIZE - metrics->length;
+    va_list args;
+    va_start(args, format);
+    gint written = g_vsnprintf(metrics->buffer + metrics->length, remaining, format, args);
+    va_end(args);
+    if (written < 0 || (gsize)written >= remaining) {
+        metrics->truncated = TRUE;
+        return;
+    }
+    metrics->length += written;
+}
+
+static void metrics_counter(MetricsServer *metrics, const gchar *name, const gchar *help, guint64 value) {
+    metrics_appendf(metrics, "# TYPE %s counter\n# HELP %s %s\n%s_total %" G_GUINT64_FORMAT "\n",
+                    name, name, help, name, value);
+}
+
+static void metrics_gauge(MetricsServer *metrics, const gchar *name, const gchar *help, gdouble value) {
+    metrics_appendf(metrics, "# TYPE %s gauge\n# HELP %s %s\n%s %.6g\n", name, name, help, name, value);
+}
+
+// Render every metric into metrics->buffer. Reads the same lock-free counters as GetStats;
+// the streaming threads are never blocked by a scrape.
+static void render_metrics(CustomData *data) {
+    MetricsServer *metrics = &data->metrics;
+    grpc_stats_t stats = {0};
+    gchar encoder[64] = "";
+    gdouble restart_ms_total;
+
+    metrics->length = 0;
+    metrics->truncated = FALSE;
+
+    grpc_get_stats_cb(data, &stats);
+    g_mutex_lock(&data->state_mutex);
+    if (data->active_branch && data->active_branch->encoder_name) {
+        g_strlcpy(encoder, data->active_branch->encoder_name, sizeof(encoder));
+    }
+    g_mutex_unlock(&data->state_mutex);
+    g_mutex_lock(&data->stats.stats_mutex);
+    restart_ms_total = data->stats.restart_ms_total;
+    g_mutex_unlock(&data->stats.stats_mutex);
+
+    metrics_counter(metrics, "f1sh_tx_bytes", "UDP payload bytes handed to the sink.", stats.total_bytes);
+    metrics_counter(metrics, "f1sh_tx_packets", "RTP packets handed to the sink.", stats.rtp_packets);
+    metrics_counter(metrics, "f1sh_encoded_frames", "Access units leaving the parser.", stats.frame_count);
+    metrics_counter(metrics, "f1sh_encoded_keyframes", "Keyframes leaving the parser.", stats.keyframes);
+    metrics_counter(metrics, "f1sh_encoded_bytes", "H.264 bytes before RTP packetization.", stats.encoded_bytes);
+    metrics_counter(metrics, "f1sh_fec_packets", "FEC packets produced.", stats.fec_packets);
+    metrics_counter(metrics, "f1sh_rtx_requests", "Packets NACKed by receivers.", stats.rtx_requests);
+    metrics_counter(metrics, "f1sh_rtx_packets", "RTP retransmissions sent.", stats.rtx_packets);
+    metrics_counter(metrics, "f1sh_tx_syscalls", "Send calls made by the branch sink (one per rendered buffer or list with udpsink).", stats.tx_syscalls);
+    metrics_counter(metrics, "f1sh_tx_gso_sends", "Messages segmented by UDP GSO.", stats.tx_gso_sends);
+    metrics_counter(metrics, "f1sh_pacing_overruns", "Bursts let through to stay within the pacing delay.",
+                    stats.pacing_overruns);
+    metrics_gauge(metrics, "f1sh_pacing_queue_depth", "Packets waiting in the pace queue.", stats.pacing_queue_depth);
+    metrics_gauge(metrics, "f1sh_pacing_delay_max_seconds", "Longest wait for pacing tokens.",
+                  stats.pacing_delay_max_ms / 1000.0);
+    metrics_counter(metrics, "f1sh_udp_sndbuf_errors", "UDP sends dropped by the kernel since the stream started.",
+                    stats.kernel_sndbuf_errors);
+    metrics_counter(metrics, "f1sh_tx_enobufs", "Packets the batched transmitter had refused with ENOBUFS.",
+                    stats.tx_enobufs);
+    metrics_gauge(metrics, "f1sh_rtp_mtu_bytes", "Largest RTP packet the payloader produces.", stats.rtp_mtu);
+    metrics_gauge(metrics, "f1sh_rtp_overhead_ratio", "RTP and FEC bytes sent per byte of H.264.",
+                  stats.rtp_overhead_ratio);
+    metrics_counter(metrics, "f1sh_encoder_input_dmabuf_buffers", "Encoder input buffers backed by DMABuf.",
+                    stats.dmabuf_buffers);
+    metrics_counter(metrics, "f1sh_encoder_input_system_buffers", "Encoder input buffers in system memory.",
+                    stats.system_buffers);
+
+    metrics_gauge(metrics, "f1sh_bitrate_kbps", "Send bitrate over the last second.", stats.bitrate);
+    metrics_gauge(metrics, "f1sh_bitrate_5s_kbps", "Send bitrate over the last 5 seconds.", stats.bitrate_5s);
+    metrics_gauge(metrics, "f1sh_bitrate_60s_kbps", "Send bitrate over the last 60 seconds.", stats.bitrate_60s);
+    metrics_gauge(metrics, "f1sh_bitrate_ewma_kbps", "Smoothed send bitrate.", stats.bitrate_ewma);
+    metrics_gauge(metrics, "f1sh_packet_rate", "RTP packets per second over the last second.", stats.packet_rate);
+    metrics_gauge(metrics, "f1sh_frame_rate", "Encoded frames per second over the last second.", stats.frame_rate);
+    metrics_gauge(metrics, "f1sh_target_bitrate_kbps", "Bitrate the encoder is set to.", stats.target_bitrate_kbps);
+    metrics_counter(metrics, "f1sh_bitrate_decreases", "Adaptive bitrate cuts.", stats.bitrate_decreases);
+    metrics_counter(metrics, "f1sh_bitrate_increases", "Adaptive bitrate increases.", stats.bitrate_increases);
+
+    metrics_appendf(metrics,
+                    "# TYPE f1sh_pipeline_rebuild_seconds summary\n"
+                    "# HELP f1sh_pipeline_rebuild_seconds Teardown-to-PLAYING time of full pipeline rebuilds.\n"
+                    "f1sh_pipeline_rebuild_seconds_count %u\n"
+                    "f1sh_pipeline_rebuild_seconds_sum %.6f\n",
+                    stats.restarts, restart_ms_total / 1000.0);
+    metrics_gauge(metrics, "f1sh_pipeline_last_rebuild_seconds", "Duration of the most recent pipeline start.",
+                  stats.last_restart_ms / 1000.0);
+    metrics_counter(metrics, "f1sh_renegotiations", "Size or framerate changes applied in place.",
+                    stats.renegotiations);
+    metrics_counter(metrics, "f1sh_renegotiation_fallbacks", "In-place changes that ended in a rebuild.",
+                    stats.renegotiation_fallbacks);
+    metrics_counter(metrics, "f1sh_standby_swaps", "Encoder changes completed on a standby branch.",
+                    stats.standby_swaps);
+    metrics_counter(metrics, "f1sh_standby_swap_fallbacks", "Standby swaps that ended in a rebuild.",
+                    stats.standby_swap_fallbacks);
+    metrics_counter(metrics, "f1sh_dmabuf_fallbacks", "Times the DMABuf path was abandoned.",
+                    stats.dmabuf_fallbacks);
+    metrics_counter(metrics, "f1sh_destination_switches", "Host/port changes applied without a rebuild.",
+                    stats.destination_switches);
+
+    metrics_appendf(metrics,
+                    "# TYPE f1sh_encoder info\n"
+                    "# HELP f1sh_encoder Encoder element feeding the network.\n"
+                    "f1sh_encoder_info{encoder=\"%s\",capture_path=\"%s\"} 1\n",
+                    encoder, stats.zero_copy_active ? "dmabuf" : "system");
+
+    gchar codes[SERIAL_METRIC_SLOTS][16];
+    for (gsize i = 0; i < SERIAL_METRIC_SLOTS; i++) {
+        if (i < G_N_ELEMENTS(serial_metric_codes)) {
+            g_snprintf(codes[i], sizeof(codes[i]), "%d", serial_metric_codes[i]);
+        } else {
+            g_strlcpy(codes[i], "other", sizeof(codes[i]));
+        }
+    }
+    metrics_appendf(metrics,
+                    "# TYPE f1sh_serial_requests counter\n"
+                    "# HELP f1sh_serial_requests Serial control requests by status code.\n");
+    for (gsize i = 0; i < SERIAL_METRIC_SLOTS; i++) {
+        metrics_appendf(metrics, "f1sh_serial_requests_total{status=\"%s\"} %" G_GUINT64_FORMAT "\n", codes[i],
+                        (guint64)atomic_load_explicit(&data->serial.requests[i], memory_order_relaxed));
+    }
+    metrics_appendf(metrics,
+                    "# TYPE f1sh_serial_requests_failed counter\n"
+                    "# HELP f1sh_serial_requests_failed Serial control requests that failed, by status code.\n");
+    for (gsize i = 0; i < SERIAL_METRIC_SLOTS; i++) {
+        metrics_appendf(metrics, "f1sh_serial_requests_failed_total{status=\"%s\"} %" G_GUINT64_FORMAT "\n",
+                        codes[i], (guint64)atomic_load_explicit(&data->serial.failures[i], memory_order_relaxed));
+    }
+
+    grpc_rpc_latency_t rpcs[16];
+    gint num_rpcs = f1sh_grpc_server_get_rpc_latency(data->grpc_server, rpcs, G_N_ELEMENTS(rpcs));
+    static const gdouble bounds_ms[] = GRPC_RPC_LATENCY_BOUNDS_MS;
+    metrics_appendf(metrics,
+                    "# TYPE f1sh_rpc_duration_seconds histogram\n"
+                    "# HELP f1sh_rpc_duration_seconds Handling time of unary gRPC calls.\n");
+    for (gint i = 0; i < num_rpcs; i++) {
+        guint64 cumulative = 0;
+        for (gsize b = 0; b < G_N_ELEMENTS(bounds_ms); b++) {
+            cumulative += rpcs[i].buckets[b];
+            metrics_appendf(metrics, "f1sh_rpc_duration_seconds_bucket{method=\"%s\",le=\"%g\"} %" G_GUINT64_FORMAT "\n",
+                            rpcs[i].method, bounds_ms[b] / 1000.0, cumulative);
+        }
+        metrics_appendf(metrics,
+                        "f1sh_rpc_duration_seconds_bucket{method=\"%s\",le=\"+Inf\"} %llu\n"
+                        "f1sh_rpc_duration_seconds_count{method=\"%s\"} %llu\n"
+                        "f1sh_rpc_duration_seconds_sum{method=\"%s\"} %.6f\n",
+                        rpcs[i].method, rpcs[i].count, rpcs[i].method, rpcs[i].count,
+                        rpcs[i].method, rpcs[i].sum_ms / 1000.0);
+    }
+
+    metrics_appendf(metrics, "# EOF\n");
+}
+
+static gboolean metrics_send_all(int fd, const gchar *buffer, gsize length) {
+#ifdef MSG_NOSIGNAL
+    const int flags = MSG_NOSIGNAL;
+#else
+    const int flags = 0;
+#endif
+    gsize sent = 0;
+    while (sent < length) {
+        ssize_t n = send(fd, buffer + sent, length - sent, flags);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return FALSE;
+        }
+        sent += n;
+    }
+    return TRUE;
+}
+
+static void handle_metrics_client(CustomData *data, int fd) {
+    gchar request[1024];
+    gsize received = 0;
+
+    // Only the request line matters; give slow clients a second in total to send it
+    gint64 deadline = g_get_monotonic_time() + METRICS_REQUEST_TIMEOUT_MS * 1000;
+    while (received < sizeof(request) - 1) {
+        gint64 remaining_ms = (deadline - g_get_monotonic_time()) / 1000;
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        if (remaining_ms <= 0 || poll(&pfd, 1, (int)remaining_ms) <= 0) {
+            break;
+        }
+        ssize_t n = recv(fd, request + received, sizeof(request) - 1 - received, 0);
+        if (n <= 0) {
+            break;
+        }
+        received += n;
+        request[received] = '\0';
+        if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n")) {
+            break;
+        }
+    }
+    request[received] = '\0';
+
+    gchar header[256];
+    if (g_str_has_prefix(request, "GET /metrics ") || g_str_has_prefix(request, "GET / ")) {
+        render_metrics(data);
+        if (data->metrics.truncated) {
+            g_printerr("Metrics: output exceeded %d bytes, response truncated\n", METRICS_BUFFER_SIZE);
+        }
+        gint header_len = g_snprintf(header, sizeof(header),
+                                     "HTTP/1.1 200 OK\r\n"
+                                     "Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+                                     "Content-Length: %" G_GSIZE_FORMAT "\r\n"
+                                     "Connection: close\r\n\r\n",
+                                     data->metrics.length);
+        if (metrics_send_all(fd, header, header_len)) {
+            metrics_send_all(fd, data->metrics.buffer, data->metrics.length);
+        }
+    } else {
+        static const gchar not_found[] =
+            "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        metrics_send_all(fd, not_found, sizeof(not_found) - 1);
+    }
+}
+
+static gpointer metrics_server_thread(gpointer user_data) {
+    CustomData *data = (CustomData *)user_data;
+    MetricsServer *metrics = &data->metrics;
+
+    while (g_atomic_int_get(&metrics->running)) {
+        struct pollfd pfd = { .fd = metrics->listen_fd, .events = POLLIN };
+        int ready = poll(&pfd, 1, 200);
+        if (ready <= 0) {
+            continue;
+        }
+        int client = accept(metrics->listen_fd, NULL, NULL);
+        if (client < 0) {
+            continue;
+        }
+        handle_metrics_client(data, client);
+        close(client);
+    }
+
+    return NULL;
+}
+
+// Start the metrics listener. Failure is not fatal; the stream runs without it.
+static gboolean start_metrics_server(CustomData *data) {
+    MetricsServer *metrics = &data->metrics;
+    gint port = METRICS_PORT;
+    const gchar *env_port = g_getenv("F1SH_METRICS_PORT");
+
+    metrics->listen_fd = -1;
+    if (env_port && *env_port) {
+        port = atoi(env_port);
+    }
+    if (port <= 0 || port > 65535) {
+        g_print("Metrics endpoint disabled\n");
+        return TRUE;
+    }
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        g_printerr("Metrics: socket failed: %s\n", g_strerror(errno));
+        return FALSE;
+    }
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 4) < 0) {
+        g_printerr("Metrics: cannot listen on port %d: %s\n", port, g_strerror(errno));
+        close(fd);
+        return FALSE;
+    }
+
+    metrics->listen_fd = fd;
+    metrics->buffer = g_malloc(METRICS_BUFFER_SIZE);
+    g_atomic_int_set(&metrics->running, 1);
+    metrics->thread = g_thread_new("metrics-http", metrics_server_thread, data);
+    g_print("Metrics endpoint on http://0.0.0.0:%d/metrics\n", port);
+    return TRUE;
+}
+
+static void stop_metrics_server(CustomData *data) {
+    MetricsServer *metrics = &data->metrics;
+    if (metrics->thread) {
+        g_atomic_int_set(&metrics->running, 0);
+        g_thread_join(metrics->thread);
+        metrics->thread = NULL;
+    }
+    if (metrics->listen_fd >= 0) {
+        close(metrics->listen_fd);
+        metrics->listen_fd = -1;
+    }
+    g_free(metrics->buffer);
+    metrics->buffer = NULL;
+}
+
+// ==================== End of Metrics Endpoint ====================
+
+// Link decodebin's video pad to the converter inside the file source bin
+static void file_source_pad_added(GstElement *decodebin __attribute__((unused)), GstPad *pad, gpointer user_data) {
+    GstElement *convert = (GstElement *)user_data;
+    GstPad *convert_pad = gst_element_get_static_pad(convert, "sink");
+    if (!convert_pad) {
+        return;
+    }
+
+    if (gst_pad_is_linked(convert_pad)) {
+        gst_object_unref(convert_pad);
+        return;
+    }
+
+    GstCaps *caps = gst_pad_get_current_caps(pad);
+    if (!caps) {
+        caps = gst_pad_query_caps(pad, NULL);
+    }
+    const gchar *media_type = gst_structure_get_name(gst_caps_get_structure(caps, 0));
+    if (g_str_has_prefix(media_type, "video/x-raw")) {
+        if (gst_pad_link(pad, convert_pad) != GST_PAD_LINK_OK) {
+            g_printerr("File source: failed to link decoded %s pad\n", media_type);
+        } else {
+            g_print("File source: linked decoded %s stream\n", media_type);
+        }
+    }
+    gst_caps_unref(caps);
+    gst_object_unref(convert_pad);
+}
+
+// Build "filesrc ! decodebin ! videoconvert ! videoscale ! videorate ! identity sync=true"
+// wrapped in a bin with a ghost src pad, so a recorded clip can stand in for a camera.
+static GstElement* create_file_source(const char *location) {
+    if (!location || location[0] == '\0') {
+        g_printerr("File source requires source_device to point at a media file.\n");
+        return NULL;
+    }
+
+    GstElement *bin = gst_bin_new("source");
+    GstElement *filesrc = gst_element_factory_make("filesrc", "file");
+    GstElement *decodebin = gst_element_factory_make("decodebin", "decode");
+    GstElement *convert = gst_element_factory_make("videoconvert", "file_convert");
+    GstElement *scale = gst_element_factory_make("videoscale", "file_scale");
+    GstElement *rate = gst_element_factory_make("videorate", "file_rate");
+    GstElement *pacer = gst_element_factory_make("identity", "file_pacer");
+
+    if (!filesrc || !decodebin || !convert || !scale || !rate || !pacer) {
+        g_printerr("Failed to create file source elements.\n");
+        gst_object_unref(bin);
+        if (filesrc) gst_object_unref(filesrc);
+        if (decodebin) gst_object_unref(decodebin);
+        if (convert) gst_object_unref(convert);
+        if (scale) gst_object_unref(scale);
+        if (rate) gst_object_unref(rate);
+        if (pacer) gst_object_unref(pacer);
+        return NULL;
+    }
+
+    g_object_set(filesrc, "location", location, NULL);
+    // Pace decoded frames against the pipeline clock so the sink sees a live-like stream
+    g_object_set(pacer, "sync", TRUE, NULL);
+
+    gst_bin_add_many(GST_BIN(bin), filesrc, decodebin, convert, scale, rate, pacer, NULL);
+    if (!gst_element_link(filesrc, decodebin) ||
+        !gst_element_link_many(convert, scale, rate, pacer, NULL)) {
+        g_printerr("Failed to link file source elements.\n");
+        gst_object_unref(bin);
+        return NULL;
+    }
+    g_signal_connect(decodebin, "pad-added", G_CALLBACK(file_source_pad_added), convert);
+
+    GstPad *pacer_src = gst_element_get_static_pad(pacer, "src");
+    gst_element_add_pad(bin, gst_ghost_pad_new("src", pacer_src));
+    gst_object_unref(pacer_src);
+
+    g_print("Using file source: %s\n", location);
+    return bin;
+}
+
+// Create the capture element selected by config->source_type
+static GstElement* create_video_source(const AppConfig *config) {
+    GstElement *src = NULL;
+    const gchar *source_type = config->source_type ? config->source_type : DEFAULT_SOURCE_TYPE;
+
+    if (strcmp(source_type, "libcamera") == 0) {
+        src = gst_element_factory_make("libcamerasrc", "source");
+        if (!src) {
+            g_printerr("Failed to create libcamerasrc.\n");
+            return NULL;
+        }
+        g_print("Successfully created libcamerasrc element\n");
+
+        // Set camera name if specified
+        if (strlen(config->camera_name) > 0 && strcmp(config->camera_name, "auto-detect") != 0) {
+            g_object_set(src, "camera-name", config->camera_name, NULL);
+            g_print("Using camera: %s\n", config->camera_name);
+        } else {
+            g_print("Using auto-detected camera\n");
+        }
+    } else if (strcmp(source_type, "v4l2") == 0) {
+        const gchar *device = (config->source_device && config->source_device[0] != '\0')
+                                  ? config->source_device : DEFAULT_V4L2_DEVICE;
+        src = gst_element_factory_make("v4l2src", "source");
+        if (!src) {
+            g_printerr("Failed to create v4l2src.\n");
+            return NULL;
+        }
+        g_object_set(src, "device", device, NULL);
+        g_print("Using V4L2 device: %s\n", device);
+    } else if (strcmp(source_type, "videotest") == 0) {
+        src = gst_element_factory_make("videotestsrc", "source");
+        if (!src) {
+            g_printerr("Failed to create videotestsrc.\n");
+            return NULL;
+        }
+        // Live mode makes the test source produce frames at the negotiated framerate like a sensor
+        g_object_set(src, "is-live", TRUE, NULL);
+        // Bounded runs (meson test/benchmark) end with EOS after this many frames
+        const gchar *num_buffers = g_getenv("F1SH_NUM_BUFFERS");
+        if (num_buffers && num_buffers[0] != '\0') {
+            g_object_set(src, "num-buffers", (gint)g_ascii_strtoll(num_buffers, NULL, 10), NULL);
+        }
+        if (config->test_pattern && config->test_pattern[0] != '\0') {
+            gst_util_set_object_arg(G_OBJECT(src), "pattern", config->test_pattern);
+        }
+        if (config->test_motion && config->test_motion[0] != '\0') {
+            gst_util_set_object_arg(G_OBJECT(src), "motion", config->test_motion);
+        }
+        g_print("Using test source: pattern=%s, motion=%s\n",
+                config->test_pattern ? config->test_pattern : "default",
+                config->test_motion ? config->test_motion : "default");
+    } else if (strcmp(source_type, "file") == 0) {
+        src = create_file_source(config->source_device);
+    } else {
+        g_printerr("Unknown source type '%s'.\n", source_type);
+    }
+
+    return src;
+}
+
+static gboolean source_is_device(const AppConfig *config) {
+    return strcmp(config->source_type, "libcamera") == 0 || strcmp(config->source_type, "v4l2") == 0;
+}
+
+// Bring a device-backed source to READY (which opens the camera), retrying with
+// exponential backoff while the previous pipeline's handle is still being released.
+// Returns the time spent waiting in microseconds, or -1 if the device never freed up.
+static gint64 acquire_source_device(GstElement *src) {
+    gint64 start = g_get_monotonic_time();
+    gulong backoff = CAMERA_ACQUIRE_INITIAL_BACKOFF_USEC;
+    guint attempt = 0;
+
+    while (TRUE) {
+        attempt++;
+        if (gst_element_set_state(src, GST_STATE_READY) == GST_STATE_CHANGE_SUCCESS) {
+            gint64 waited = g_get_monotonic_time() - start;
+            if (attempt > 1) {
+                g_print("Capture device available after %u attempts (%.1f ms)\n", attempt, waited / 1000.0);
+            }
+            return waited;
+        }
+        gst_element_set_state(src, GST_STATE_NULL);
+
+        if (g_get_monotonic_time() - start + (gint64)backoff > CAMERA_ACQUIRE_TIMEOUT_USEC) {
+            g_printerr("Capture device still busy after %u attempts, giving up\n", attempt);
+            return -1;
+        }
+        g_usleep(backoff);
+        backoff = MIN(backoff * 2, CAMERA_ACQUIRE_MAX_BACKOFF_USEC);
+    }
+}
+
+// Query an element's pad caps, probing the device in READY when possible so the
+// answer reflects the hardware rather than the pad template. Elements we bring up
+// are returned to NULL so properties that are only writable in NULL can still be
+// set; elements that are already open (an acquired source) are left as they are.
+static GstCaps* query_element_caps(GstElement *element, const gchar *pad_name, GstCaps *filter) {
+    GstPad *pad = gst_element_get_static_pad(element, pad_name);
+    if (!pad) {
+        return NULL;
+    }
+
+    GstState current = GST_STATE_NULL;
+    gst_element_get_state(element, &current, NULL, 0);
+    gboolean probed = current == GST_STATE_NULL &&
+                      gst_element_set_state(element, GST_STATE_READY) == GST_STATE_CHANGE_SUCCESS;
+    GstCaps *caps = gst_pad_query_caps(pad, filter);
+    if (probed) {
+        gst_element_set_state(element, GST_STATE_NULL);
+    }
+    gst_object_unref(pad);
+    return caps;
+}
+
+// Find a raw format that both the source and the encoder accept at the configured
+// size and rate, honouring config->pixel_format when it is shared. Returns a newly
+// allocated format string, or NULL when a converter is required.
+static gchar* negotiate_shared_format(GstElement *src, GstElement *encoder, const AppConfig *config) {
+    GstCaps *filter = gst_caps_new_simple("video/x-raw",
+                                          "width", G_TYPE_INT, config->width,
+                                          "height", G_TYPE_INT, config->height,
+                                          "framerate", GST_TYPE_FRACTION, config->framerate, 1,
+                                          NULL);
+    GstCaps *src_caps = query_element_caps(src, "src", filter);
+    GstCaps *enc_caps = query_element_caps(encoder, "sink", filter);
+    gst_caps_unref(filter);
+
+    if (!src_caps || !enc_caps) {
+        if (src_caps) gst_caps_unref(src_caps);
+        if (enc_caps) gst_caps_unref(enc_caps);
+        return NULL;
+    }
+
+    // Keep the encoder's order of preference when several formats are shared
+    GstCaps *common = gst_caps_intersect_full(enc_caps, src_caps, GST_CAPS_INTERSECT_FIRST);
+    gst_caps_unref(src_caps);
+    gst_caps_unref(enc_caps);
+
+    gchar *format = NULL;
+    if (!gst_caps_is_empty(common)) {
+        const gchar *preferred = config->pixel_format;
+        if (preferred && preferred[0] != '\0' && g_ascii_strcasecmp(preferred, "auto") != 0) {
+            GstCaps *preferred_caps = gst_caps_new_simple("video/x-raw", "format", G_TYPE_STRING, preferred, NULL);
+            if (gst_caps_can_intersect(common, preferred_caps)) {
+                format = g_strdup(preferred);
+            } else {
+                g_print("Preferred pixel format %s is not shared by source and encoder\n", preferred);
+            }
+            gst_caps_unref(preferred_caps);
+        }
+
+        if (!format) {
+            GstCaps *fixed = gst_caps_fixate(gst_caps_copy(common));
+            const gchar *first = gst_structure_get_string(gst_caps_get_structure(fixed, 0), "format");
+            format = first ? g_strdup(first) : NULL;
+            gst_caps_unref(fixed);
+        }
+    }
+    gst_caps_unref(common);
+
+    return format;
+}
+
+// Element names carry the branch generation so a standby branch can sit next to the
+// active one; the first branch keeps the plain names ("encoder", "sink", ...)
+static gchar* branch_element_name(const gchar *base, guint generation) {
+    return generation == 0 ? g_strdup(base) : g_strdup_printf("%s-%u", base, generation);
+}
+
+// Create the configured encoder, falling back to the other known H.264 encoders. Candidates
+// the startup probe found missing, unable to open, or too small for the configured size are
+// skipped. The factory that was actually used is returned in actual_name_out.
+static GstElement* create_encoder(EncoderRegistry *registry, const AppConfig *config,
+                                  const gchar *element_name, gchar **actual_name_out) {
+    GstElement *encoder = NULL;
+    *actual_name_out = NULL;
+
+    for (gint i = -1; i < (gint)G_N_ELEMENTS(known_encoders) && !encoder; i++) {
+        const gchar *candidate = i < 0 ? config->encoder_type : known_encoders[i];
+        // Skip if we already tried this encoder
+        if (i >= 0 && strcmp(candidate, config->encoder_type) == 0) {
+            continue;
+        }
+
+        const EncoderCapability *cap = encoder_registry_lookup(registry, candidate);
+        if (cap && !cap->available) {
+            g_print("Encoder %s not available\n", candidate);
+            continue;
+        }
+        if (cap && !cap->ready_ok) {
+            g_print("Skipping encoder %s: it failed to open during the startup probe\n", candidate);
+            continue;
+        }
+        if (cap && ((cap->max_width > 0 && config->width > cap->max_width) ||
+                    (cap->max_height > 0 && config->height > cap->max_height))) {
+            g_print("Skipping encoder %s: %dx%d exceeds its %dx%d limit\n", candidate,
+                    config->width, config->height, cap->max_width, cap->max_height);
+            continue;
+        }
+
+        g_print("Trying encoder: %s\n", candidate);
+        encoder = gst_element_factory_make(candidate, element_name);
+        if (encoder) {
+            *actual_name_out = g_strdup(candidate);
+            g_print("Successfully created encoder: %s\n", *actual_name_out);
+            break;
+        } else {
+            g_print("Encoder %s not available\n", candidate);
+        }
+    }
+
+    return encoder;
+}
+
+// Set the encoder's target bitrate. Every encoder we know of accepts this while PLAYING;
+// v4l2h264enc pushes extra-controls to the open device as soon as they are set.
+static void set_encoder_bitrate(GstElement *encoder, const gchar *encoder_name, guint kbps) {
+    if (strcmp(encoder_name, "v4l2h264enc") == 0) {
+        // Resend repeat_sequence_header with it; extra-controls replaces the whole set
+        GstStructure *ctrls = gst_structure_new("controls",
+                                               "repeat_sequence_header", G_TYPE_BOOLEAN, TRUE,
+                                               "video_bitrate", G_TYPE_INT, (gint)(kbps * 1000),
+                                               NULL);
+        g_object_set(encoder, "extra-controls", ctrls, NULL);
+        gst_structure_free(ctrls);
+    } else if (strcmp(encoder_name, "omxh264enc") == 0) {
+        g_object_set(encoder, "target-bitrate", kbps * 1000, NULL);  // bits/sec
+    } else if (strcmp(encoder_name, "x264enc") == 0 || strcmp(encoder_name, "nvh264enc") == 0 ||
+               strcmp(encoder_name, "vaapih264enc") == 0) {
+        g_object_set(encoder, "bitrate", kbps, NULL);
+    }
+}
+
+// Configure encoder settings based on the actual encoder being used
+static void configure_encoder(GstElement *encoder, const gchar *encoder_name, gboolean use_dmabuf,
+                              guint bitrate_kbps) {
+    if (strcmp(encoder_name, "x264enc") == 0) {
+        g_print("Configuring x264enc encoder\n");
+        g_object_set(encoder, 
+                     "tune", 0x00000004,  // zerolatency
+                     "speed-preset", 1,   // superfast
+                     "threads", 1,        // Single thread for low latency
+                     "key-int-max", 30,   // GOP size
+                     NULL);
+    } else if (strcmp(encoder_name, "v4l2h264enc") == 0) {
+        g_print("Configuring v4l2h264enc encoder\n");
+        if (use_dmabuf) {
+            // Queue the source's DMABufs directly on the encoder's OUTPUT queue
+            gst_util_set_object_arg(G_OBJECT(encoder), "output-io-mode", "dmabuf-import");
+            g_print("v4l2h264enc importing DMABufs (zero-copy capture path)\n");
+        }
+    } else if (strcmp(encoder_name, "omxh264enc") == 0) {
+        g_print("Configuring omxh264enc encoder\n");
+        g_object_set(encoder,
+                     "control-rate", 2,          // variable bitrate
+                     NULL);
+    } else if (strcmp(encoder_name, "nvh264enc") == 0) {
+        g_print("Configuring nvh264enc encoder\n");
+        g_object_set(encoder,
+                     "gop-size", 30,
+                     "preset", 1,  // low-latency-hq
+                     NULL);
+    } else if (strcmp(encoder_name, "vaapih264enc") == 0) {
+        g_print("Configuring vaapih264enc encoder\n");
+        g_object_set(encoder,
+                     "keyframe-period", 30,
+                     NULL);
+    }
+    set_encoder_bitrate(encoder, encoder_name, bitrate_kbps);
+    g_print("Encoder bitrate %u kbps\n", bitrate_kbps);
+}
+
+static void set_rtp_seqnum(GstBuffer *buffer, guint16 seqnum) {
+    guint8 bytes[2] = {seqnum >> 8, seqnum & 0xff};
+    gst_buffer_fill(buffer, 2, bytes, sizeof(bytes));
+}
+
+// Drops payloader output while the branch is not the one feeding the network. Branches fed
+// from the tee take their sequence numbers from one shared counter as they pass the gate,
+// so the first packet of a standby branch follows the last one the old branch sent,
+// however long the old branch kept streaming while the standby waited for its IDR.
+static GstPadProbeReturn
+branch_gate_probe_callback (GstPad *pad __attribute__((unused)), GstPadProbeInfo *info, gpointer user_data)
+{
+    EncodeBranch *branch = (EncodeBranch *)user_data;
+    if (!g_atomic_int_get(&branch->gate_open)) {
+        return GST_PAD_PROBE_DROP;
+    }
+    if (!branch->queue) {
+        return GST_PAD_PROBE_OK;
+    }
+
+    atomic_uint *counter = &branch->owner->rtp_seqnum;
+    if (info->type & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+        GstBufferList *list = gst_buffer_list_make_writable(GST_PAD_PROBE_INFO_BUFFER_LIST(info));
+        GST_PAD_PROBE_INFO_DATA(info) = list;
+        guint length = gst_buffer_list_length(list);
+        guint seqnum = atomic_fetch_add_explicit(counter, length, memory_order_relaxed);
+        for (guint i = 0; i < length; i++) {
+            set_rtp_seqnum(gst_buffer_list_get_writable(list, i), (guint16)(seqnum + i));
+        }
+    } else {
+        GstBuffer *buffer = gst_buffer_make_writable(GST_PAD_PROBE_INFO_BUFFER(info));
+        GST_PAD_PROBE_INFO_DATA(info) = buffer;
+        set_rtp_seqnum(buffer, (guint16)atomic_fetch_add_explicit(counter, 1, memory_order_relaxed));
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+// ==================== NAL Inspector ====================
+
+// Length prefix size of AVC-format H.264 (from avcC codec_data), or 0 for byte-stream
+static guint h264_nal_length_size(const GstCaps *caps) {
+    if (!caps || gst_caps_get_size(caps) == 0) {
+        return 0;
+    }
+    const GstStructure *s = gst_caps_get_structure(caps, 0);
+    const gchar *format = gst_structure_get_string(s, "stream-format");
+    if (g_strcmp0(format, "avc") != 0 && g_strcmp0(format, "avc3") != 0) {
+        return 0;
+    }
+
+    guint length_size = 4;
+    const GValue *codec_data = gst_structure_get_value(s, "codec_data");
+    if (codec_data && G_VALUE_HOLDS(codec_data, GST_TYPE_BUFFER)) {
+        GstBuffer *avcc = gst_value_get_buffer(codec_data);
+        guint8 byte;
+        if (gst_buffer_extract(avcc, 4, &byte, 1) == 1) {
+            length_size = (byte & 0x03) + 1;
+        }
+    }
+    return length_size;
+}
+
+// Reads Exp-Golomb fields from the start of a slice header. The caller strips emulation
+// prevention bytes from the few bytes it hands over.
+typedef struct {
+    const guint8 *data;
+    gsize size;
+    gsize bit;
+} NalBitReader;
+
+static gboolean nal_read_ue(NalBitReader *reader, guint *value) {
+    guint zeros = 0;
+    while (TRUE) {
+        if (reader->bit >= reader->size * 8 || zeros > 31) {
+            return FALSE;
+        }
+        guint b = (reader->data[reader->bit / 8] >> (7 - reader->bit % 8)) & 1;
+        reader->bit++;
+        if (b) {
+            break;
+        }
+        zeros++;
+    }
+    guint suffix = 0;
+    for (guint i = 0; i < zeros; i++) {
+        if (reader->bit >= reader->size * 8) {
+            return FALSE;
+        }
+        suffix = (suffix << 1) | ((reader->data[reader->bit / 8] >> (7 - reader->bit % 8)) & 1);
+        reader->bit++;
+    }
+    *value = (1u << zeros) - 1 + suffix;
+    return TRUE;
+}
+
+// Picture type of a slice NAL from its slice_type field, or -1 if unreadable
+static gint slice_frame_type(const guint8 *nal, gsize size) {
+    if ((nal[0] & 0x1f) == 5) {
+        return FRAME_TYPE_IDR;
+    }
+
+    // first_mb_in_slice and slice_type fit in the first few RBSP bytes
+    guint8 rbsp[16];
+    gsize len = 0;
+    guint zeros = 0;
+    for (gsize i = 1; i < size && len < sizeof(rbsp); i++) {
+        if (zeros >= 2 && nal[i] == 0x03) {
+            zeros = 0;
+            continue;
+        }
+        zeros = nal[i] == 0 ? zeros + 1 : 0;
+        rbsp[len++] = nal[i];
+    }
+
+    NalBitReader reader = { rbsp, len, 0 };
+    guint first_mb, slice_type;
+    if (!nal_read_ue(&reader, &first_mb) || !nal_read_ue(&reader, &slice_type)) {
+        return -1;
+    }
+    switch (slice_type % 5) {
+        case 0: case 3: return FRAME_TYPE_P;   // P, SP
+        case 1: return FRAME_TYPE_B;
+        default: return FRAME_TYPE_I;          // I, SI
+    }
+}
+
+// Walk the NAL units of one access unit up to its first slice, counting parameter sets.
+// Returns the picture type, or -1 when no slice was found. Nothing is copied; parameter
+// sets and SEI come before the first slice, so the rest of the frame is never scanned.
+static gint inspect_access_unit(FrameAnalytics *analytics, const guint8 *data, gsize size,
+                                guint nal_length_size) {
+    gsize pos = 0;
+
+    while (pos < size) {
+        gsize nal_start, nal_end;
+
+        if (nal_length_size > 0) {
+            if (size - pos < nal_length_size) {
+                return -1;
+            }
+            gsize nal_size = 0;
+            for (guint i = 0; i < nal_length_size; i++) {
+                nal_size = (nal_size << 8) | data[pos + i];
+            }
+            nal_start = pos + nal_length_size;
+            if (nal_size > size - nal_start) {
+                return -1;
+            }
+            nal_end = nal_start + nal_size;
+        } else {
+            // Find the next 00 00 01 start code; the NAL runs to the one after it
+            gsize i = pos;
+            while (i + 2 < size && !(data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1)) {
+                i++;
+            }
+            if (i + 2 >= size) {
+                return -1;
+            }
+            nal_start = i + 3;
+            nal_end = nal_start;
+            while (nal_end + 2 < size &&
+                   !(data[nal_end] == 0 && data[nal_end + 1] == 0 && data[nal_end + 2] <= 1)) {
+                nal_end++;
+            }
+            if (nal_end + 2 >= size) {
+                nal_end = size;
+            }
+        }
+
+        if (nal_end > nal_start) {
+            switch (data[nal_start] & 0x1f) {
+                case 1:
+                case 5:
+                    return slice_frame_type(data + nal_start, nal_end - nal_start);
+                case 7:
+                    atomic_fetch_add_explicit(&analytics->sps, 1, memory_order_relaxed);
+                    break;
+                case 8:
+                    atomic_fetch_add_explicit(&analytics->pps, 1, memory_order_relaxed);
+                    break;
+                default:
+                    break;
+            }
+        }
+        pos = nal_end;
+    }
+
+    return -1;
+}
+
+static void record_frame(FrameAnalytics *analytics, FrameType type, gsize size) {
+    FrameSizeStats *stats = &analytics->types[type];
+    guint bucket = 0;
+    while (bucket < FRAME_SIZE_BUCKETS - 1 && size > ((gsize)1024 << bucket)) {
+        bucket++;
+    }
+    atomic_fetch_add_explicit(&stats->buckets[bucket], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stats->frames, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stats->bytes, size, memory_order_relaxed);
+    if (size > atomic_load_explicit(&stats->max_bytes, memory_order_relaxed)) {
+        atomic_store_explicit(&stats->max_bytes, size, memory_order_relaxed);
+    }
+
+    if (type != FRAME_TYPE_IDR) {
+        analytics->frames_since_idr++;
+        return;
+    }
+    if (analytics->seen_idr) {
+        guint gop = analytics->frames_since_idr;
+        guint min = atomic_load_explicit(&analytics->min_gop, memory_order_relaxed);
+        atomic_store_explicit(&analytics->last_gop, gop, memory_order_relaxed);
+        if (min == 0 || gop < min) {
+            atomic_store_explicit(&analytics->min_gop, gop, memory_order_relaxed);
+        }
+        if (gop > atomic_load_explicit(&analytics->max_gop, memory_order_relaxed)) {
+            atomic_store_explicit(&analytics->max_gop, gop, memory_order_relaxed);
+        }
+        atomic_fetch_add_explicit(&analytics->gop_frames, gop, memory_order_relaxed);
+        atomic_fetch_add_explicit(&analytics->gops, 1, memory_order_relaxed);
+    }
+    analytics->seen_idr = TRUE;
+    analytics->frames_since_idr = 1;
+}
+
+// Called while building a new pipeline, before any buffer flows
+static void reset_frame_analytics(FrameAnalytics *analytics) {
+    for (int t = 0; t < FRAME_TYPE_COUNT; t++) {
+        FrameSizeStats *stats = &analytics->types[t];
+        atomic_store(&stats->frames, 0);
+        atomic_store(&stats->bytes, 0);
+        atomic_store(&stats->max_bytes, 0);
+        for (int b = 0; b < FRAME_SIZE_BUCKETS; b++) {
+            atomic_store(&stats->buckets[b], 0);
+        }
+    }
+    atomic_store(&analytics->sps, 0);
+    atomic_store(&analytics->pps, 0);
+    atomic_store(&analytics->gops, 0);
+    atomic_store(&analytics->gop_frames, 0);
+    atomic_store(&analytics->last_gop, 0);
+    atomic_store(&analytics->min_gop, 0);
+    atomic_store(&analytics->max_gop, 0);
+    analytics->frames_since_idr = 0;
+    analytics->seen_idr = FALSE;
+}
+
+// ==================== End of NAL Inspector ====================
+
+// Counts encoded access units after h264parse. Only the branch feeding the network
+// counts, so a warming standby encoder does not inflate the numbers.
+static GstPadProbeReturn
+parser_output_probe_callback (GstPad *pad __attribute__((unused)), GstPadProbeInfo *info, gpointer user_data)
+{
+    EncodeBranch *branch = (EncodeBranch *)user_data;
+
+    if (info->type & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+        GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+        if (GST_EVENT_TYPE(event) == GST_EVENT_CAPS) {
+            GstCaps *caps = NULL;
+            gst_event_parse_caps(event, &caps);
+            branch->nal_length_size = h264_nal_length_size(caps);
+        }
+        return GST_PAD_PROBE_OK;
+    }
+
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    if (buffer && g_atomic_int_get(&branch->gate_open)) {
+        StreamStats *stats = &branch->owner->stats;
+        gsize size = gst_buffer_get_size(buffer);
+        atomic_fetch_add_explicit(&stats->encoded_frames, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&stats->encoded_bytes, size, memory_order_relaxed);
+        if (!GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT)) {
+            atomic_fetch_add_explicit(&stats->keyframes, 1, memory_order_relaxed);
+
+            int_fast64_t started = atomic_load_explicit(&stats->switch_started, memory_order_relaxed);
+            if (started && atomic_compare_exchange_strong(&stats->switch_started, &started, 0)) {
+                atomic_store_explicit(&stats->last_switch_usec, g_get_monotonic_time() - started,
+                                      memory_order_relaxed);
+            }
+        }
+
+        GstMapInfo map;
+        if (gst_buffer_map(buffer, &map, GST_MAP_READ)) {
+            gint type = inspect_access_unit(&branch->owner->analytics, map.data, map.size,
+                                            branch->nal_length_size);
+            gst_buffer_unmap(buffer, &map);
+            if (type >= 0) {
+                record_frame(&branch->owner->analytics, (FrameType)type, size);
+            }
+        }
+    }
+
+    return GST_PAD_PROBE_OK;
+}
+
+// Watches a standby branch's parser output for its first IDR. That frame is the switch
+// point: it goes out on the new branch and the branch being replaced stops sending.
+static GstPadProbeReturn
+standby_keyframe_probe_callback (GstPad *pad __attribute__((unused)), GstPadProbeInfo *info, gpointer user_data)
+{
+    EncodeBranch *branch = (EncodeBranch *)user_data;
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+
+    if (!buffer || GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT)) {
+        return GST_PAD_PROBE_OK;
+    }
+
+    if (branch->replaces) {
+        g_atomic_int_set(&branch->replaces->gate_open, 0);
+    }
+    g_atomic_int_set(&branch->gate_open, 1);
+    g_atomic_int_set(&branch->keyframe_seen, 1);
+    return GST_PAD_PROBE_REMOVE;
+}
+
+static void free_encode_branch(EncodeBranch *branch) {
+    if (!branch) {
+        return;
+    }
+    if (branch->tee_pad) {
+        gst_object_unref(branch->tee_pad);
+    }
+    batch_sender_free(branch->tx);
+    g_free(branch->encoder_name);
+    g_free(branch);
+}
+
+static GSocketFamily host_family(const gchar *host) {
+    GInetAddress *address = host ? g_inet_address_new_from_string(host) : NULL;
+    if (!address) {
+        return G_SOCKET_FAMILY_INVALID;     // a name; resolved by the sink
+    }
+    GSocketFamily family = g_inet_address_get_family(address);
+    g_object_unref(address);
+    return family;
+}
+
+static gint rtcp_port_for(const AppConfig *config) {
+    return config->rtcp_port > 0 ? config->rtcp_port : config->port + 1;
+}
+
+// RTP packet size for rtp_mtu 0, by interface name prefix. Smaller packets lose less of a
+// frame to a WiFi retry limit; tunnels need room for their own headers inside a 1500 byte
+// path; USB gadget ethernet is a clean 1500 byte link (less IPv6 + UDP headers).
+static const struct {
+    const gchar *prefix;
+    gint mtu;
+} interface_rtp_mtus[] = {
+    {"wl", 1200},           // wlan0, wlp2s0
+    {"usb", 1452},          // g_ether / RNDIS gadget
+    {"rndis", 1452},
+    {"wg", 1280},           // WireGuard
+    {"tun", 1280},
+    {"tailscale", 1200},
+    {"zt", 1200},           // ZeroTier
+};
+
+// Name of the interface the kernel routes host through. connect() on a UDP socket only
+// picks the route and source address; nothing is sent. Callers hold state_mutex, so only
+// address literals are looked up: a hostname would mean a blocking DNS query.
+static gboolean egress_interface(const gchar *host, gint port, gchar *name, gsize name_len) {
+    struct addrinfo hints = { .ai_socktype = SOCK_DGRAM, .ai_flags = AI_NUMERICHOST | AI_NUMERICSERV };
+    struct addrinfo *result = NULL;
+    gchar service[16];
+    gboolean found = FALSE;
+
+    g_snprintf(service, sizeof(service), "%d", port);
+    if (!host || getaddrinfo(host, service, &hints, &result) != 0 || !result) {
+        return FALSE;
+    }
+
+    int fd = socket(result->ai_family, SOCK_DGRAM, 0);
+    struct sockaddr_storage local;
+    socklen_t local_len = sizeof(local);
+    struct ifaddrs *interfaces = NULL;
+    if (fd >= 0 && connect(fd, result->ai_addr, result->ai_addrlen) == 0 &&
+        getsockname(fd, (struct sockaddr *)&local, &local_len) == 0 && getifaddrs(&interfaces) == 0) {
+        for (struct ifaddrs *ifa = interfaces; ifa && !found; ifa = ifa->ifa_next) {
+            if (!ifa->ifa_addr || ifa->ifa_addr->sa_family != local.ss_family) {
+                continue;
+            }
+            if (local.ss_family == AF_INET) {
+                found = ((struct sockaddr_in *)ifa->ifa_addr)->sin_addr.s_addr ==
+                        ((struct sockaddr_in *)&local)->sin_addr.s_addr;
+            } else if (local.ss_family == AF_INET6) {
+                found = memcmp(&((struct sockaddr_in6 *)ifa->ifa_addr)->sin6_addr,
+                               &((struct sockaddr_in6 *)&local)->sin6_addr, sizeof(struct in6_addr)) == 0;
+            }
+            if (found) {
+                g_strlcpy(name, ifa->ifa_name, name_len);
+            }
+        }
+        freeifaddrs(interfaces);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    freeaddrinfo(result);
+    return found;
+}
+
+// MTU for the payloaders: the configured one, else the interface table (DEFAULT_RTP_MTU for
+// hostnames and unmatched interfaces). Logs when it changes.
+static gint resolve_rtp_mtu(CustomData *data) {
+    gint mtu = data->config.rtp_mtu;
+    gchar interface[64] = "";
+
+    if (mtu <= 0) {
+        mtu = DEFAULT_RTP_MTU;
+        if (egress_interface(data->config.host, data->config.port, interface, sizeof(interface))) {
+            for (gsize i = 0; i < G_N_ELEMENTS(interface_rtp_mtus); i++) {
+                if (g_str_has_prefix(interface, interface_rtp_mtus[i].prefix)) {
+                    mtu = interface_rtp_mtus[i].mtu;
+                    break;
+                }
+            }
+        }
+    }
+    if (atomic_exchange(&data->stats.rtp_mtu, mtu) != mtu) {
+        g_print("RTP MTU %d (%s), aggregate-mode %s\n", mtu,
+                data->config.rtp_mtu > 0 ? "configured" : interface[0] ? interface : "default",
+                data->config.rtp_aggregate);
+    }
+    return mtu;
+}
+
+static void set_payloader_packetization(GstElement *payloader, gint mtu, const gchar *aggregate) {
+    g_object_set(payloader, "mtu", (guint)mtu, NULL);
+    // aggregate-mode arrived in GStreamer 1.18; older payloaders only send single NAL units and FU-A
+    if (g_object_class_find_property(G_OBJECT_GET_CLASS(payloader), "aggregate-mode")) {
+        gst_util_set_object_arg(G_OBJECT(payloader), "aggregate-mode", aggregate);
+    } else if (g_strcmp0(aggregate, "none") != 0) {
+        g_printerr("rtph264pay has no aggregate-mode, ignoring rtp_aggregate %s\n", aggregate);
+    }
+}
+
+// Push rtp_mtu/rtp_aggregate into the running payloaders; they apply from the next
+// access unit. Called with state_mutex held.
+static void update_packetization(CustomData *data) {
+    if (!data->active_branch) {
+        return;
+    }
+    gint mtu = resolve_rtp_mtu(data);
+    EncodeBranch *branches[] = {data->active_branch, data->standby_branch};
+    for (gsize i = 0; i < G_N_ELEMENTS(branches); i++) {
+        if (branches[i]) {
+            set_payloader_packetization(branches[i]->payloader, mtu, data->config.rtp_aggregate);
+        }
+    }
+}
+
+// Forget the RTP session of a pipeline that is going away. Called with state_mutex held.
+static void clear_rtcp_session(RtcpSession *rtcp) {
+    if (rtcp->session) {
+        g_object_unref(rtcp->session);
+    }
+    memset(rtcp, 0, sizeof(*rtcp));
+}
+
+// Counts retransmission requests (upstream events from the RTP session when NACKs come in)
+// and the RTX packets rtprtxsend answers them with. Streaming threads only, so atomics only.
+static GstPadProbeReturn
+rtx_probe_callback (GstPad *pad __attribute__((unused)), GstPadProbeInfo *info, gpointer user_data)
+{
+    StreamStats *stats = &((CustomData *)user_data)->stats;
+
+    if (info->type & GST_PAD_PROBE_TYPE_EVENT_UPSTREAM) {
+        GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+        if (GST_EVENT_TYPE(event) == GST_EVENT_CUSTOM_UPSTREAM &&
+            gst_event_has_name(event, "GstRTPRetransmissionRequest")) {
+            atomic_fetch_add_explicit(&stats->rtx_requests, 1, memory_order_relaxed);
+        }
+        return GST_PAD_PROBE_OK;
+    }
+
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    guint8 header[2];
+    if (buffer && gst_buffer_extract(buffer, 0, header, sizeof(header)) == sizeof(header) &&
+        (header[1] & 0x7f) == RTX_PAYLOAD_TYPE) {
+        atomic_fetch_add_explicit(&stats->rtx_packets, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&stats->rtx_bytes, gst_buffer_get_size(buffer), memory_order_relaxed);
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+// rtpbin "request-aux-sender": an rtprtxsend bin for session 0 whose history is bounded
+// by time, so the memory it holds follows the bitrate rather than a packet count.
+static GstElement* rtx_aux_sender_callback(GstElement *rtpbin __attribute__((unused)), guint session,
+                                           gpointer user_data) {
+    CustomData *data = (CustomData *)user_data;
+
+    if (session != 0) {
+        return NULL;
+    }
+
+    GstElement *rtx = gst_element_factory_make("rtprtxsend", NULL);
+    if (!rtx) {
+        g_printerr("Failed to create rtprtxsend element, streaming without RTX.\n");
+        return NULL;
+    }
+    GstStructure *pt_map = gst_structure_new("application/x-rtp-pt-map",
+                                             G_STRINGIFY(H264_PAYLOAD_TYPE), G_TYPE_UINT, RTX_PAYLOAD_TYPE,
+                                             NULL);
+    g_object_set(rtx,
+                 "payload-type-map", pt_map,
+                 "max-size-time", (guint)data->config.rtx_history_ms,
+                 "max-size-packets", 0,
+                 NULL);
+    gst_structure_free(pt_map);
+
+    GstElement *bin = gst_bin_new(NULL);
+    gst_bin_add(GST_BIN(bin), rtx);
+
+    GstPad *pad = gst_element_get_static_pad(rtx, "sink");
+    gst_element_add_pad(bin, gst_ghost_pad_new("sink_0", pad));
+    gst_object_unref(pad);
+
+    pad = gst_element_get_static_pad(rtx, "src");
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_UPSTREAM,
+                      rtx_probe_callback, data, NULL);
+    gst_element_add_pad(bin, gst_ghost_pad_new("src_0", pad));
+    gst_object_unref(pad);
+
+    return bin;
+}
+
+// Add rtpbin and the RTCP sink/source to data->pipeline. The RTP legs are linked later by
+// link_rtcp_session() once the branch exists. Called with state_mutex held.
+static gboolean create_rtcp_session(CustomData *data) {
+    RtcpSession *rtcp = &data->rtcp;
+    gint rtcp_port = rtcp_port_for(&data->config);
+
+    rtcp->rtpbin = gst_element_factory_make("rtpbin", "rtpbin");
+    rtcp->rtcp_sink = gst_element_factory_make("udpsink", "rtcp_sink");
+    rtcp->rtcp_src = gst_element_factory_make("udpsrc", "rtcp_src");
+    if (!rtcp->rtpbin || !rtcp->rtcp_sink || !rtcp->rtcp_src) {
+        g_printerr("Failed to create RTCP elements (rtpbin, udpsink, udpsrc).\n");
+        GstElement *elements[] = {rtcp->rtpbin, rtcp->rtcp_sink, rtcp->rtcp_src};
+        for (gsize i = 0; i < G_N_ELEMENTS(elements); i++) {
+            if (elements[i]) {
+                gst_object_unref(gst_object_ref_sink(elements[i]));
+            }
+        }
+        memset(rtcp, 0, sizeof(*rtcp));
+        return FALSE;
+    }
+
+    // Bind for the receiver's address family, since the same socket also sends our SRs
+    g_object_set(rtcp->rtcp_src, "port", rtcp_port,
+                 "address", host_family(data->config.host) == G_SOCKET_FAMILY_IPV6 ? "::" : "0.0.0.0", NULL);
+    // SRs are not timed against the clock and must not hold up preroll
+    g_object_set(rtcp->rtcp_sink, "host", data->config.host, "port", rtcp_port,
+                 "sync", FALSE, "async", FALSE, NULL);
+    gst_bin_add_many(GST_BIN(data->pipeline), rtcp->rtpbin, rtcp->rtcp_sink, rtcp->rtcp_src, NULL);
+
+    // rtpbin asks for the aux sender when send_rtp_sink_0 is requested in link_rtcp_session()
+    if (data->config.rtx) {
+        gst_util_set_object_arg(G_OBJECT(rtcp->rtpbin), "rtp-profile", "avpf");
+        g_signal_connect(rtcp->rtpbin, "request-aux-sender", G_CALLBACK(rtx_aux_sender_callback), data);
+    }
+
+    // Send SRs from the socket RRs arrive on, so receivers that answer the source
+    // address reach us through NAT and firewalls
+    if (gst_element_set_state(rtcp->rtcp_src, GST_STATE_READY) == GST_STATE_CHANGE_FAILURE) {
+        g_printerr("Failed to open RTCP port %d.\n", rtcp_port);
+        return FALSE;
+    }
+    GSocket *socket = NULL;
+    g_object_get(rtcp->rtcp_src, "used-socket", &socket, NULL);
+    if (socket) {
+        g_object_set(rtcp->rtcp_sink, "socket", socket, "close-socket", FALSE, NULL);
+        g_object_unref(socket);
+    }
+
+    g_print("RTCP enabled: SRs to %s:%d, RRs on port %d\n", data->config.host, rtcp_port, rtcp_port);
+    if (data->config.rtx) {
+        g_print("RTX enabled: PT %d, %d ms history\n", RTX_PAYLOAD_TYPE, data->config.rtx_history_ms);
+    }
+    return TRUE;
+}
+
+// payloader → rtpbin session 0 → sink, plus the RTCP send and receive legs
+static gboolean link_rtcp_session(CustomData *data, GstElement *payloader, GstElement *sink) {
+    RtcpSession *rtcp = &data->rtcp;
+
+    if (!gst_element_link_pads(payloader, "src", rtcp->rtpbin, "send_rtp_sink_0") ||
+        !gst_element_link_pads(rtcp->rtpbin, "send_rtp_src_0", sink, "sink") ||
+        !gst_element_link_pads(rtcp->rtpbin, "send_rtcp_src_0", rtcp->rtcp_sink, "sink") ||
+        !gst_element_link_pads(rtcp->rtcp_src, "src", rtcp->rtpbin, "recv_rtcp_sink_0")) {
+        g_printerr("Failed to link rtpbin session.\n");
+        return FALSE;
+    }
+
+    g_signal_emit_by_name(rtcp->rtpbin, "get-internal-session", 0, &rtcp->session);
+    return TRUE;
+}
+
+// ==================== Batched Transmit ====================
+
+static void batch_sender_free(BatchSender *tx) {
+    if (!tx) {
+        return;
+    }
+    for (guint i = 0; i < tx->pending_count; i++) {
+        gst_buffer_unref(tx->pending[i]);
+    }
+    if (tx->fd >= 0) {
+        close(tx->fd);
+    }
+    g_mutex_clear(&tx->mutex);
+    g_free(tx);
+}
+
+static BatchSender* batch_sender_new(StreamStats *stats) {
+    BatchSender *tx = g_new0(BatchSender, 1);
+    g_mutex_init(&tx->mutex);
+    tx->stats = stats;
+
+    // One dual-stack socket reaches IPv4 and IPv6 receivers, so a batch is a single call
+    tx->family = AF_INET6;
+    tx->fd = socket(AF_INET6, SOCK_DGRAM, 0);
+    if (tx->fd >= 0) {
+        int v6only = 0;
+        if (setsockopt(tx->fd, IPPROTO_IPV6, IPV6_V6ONLY, &v6only, sizeof(v6only)) < 0) {
+            close(tx->fd);
+            tx->fd = -1;
+        }
+    }
+    if (tx->fd < 0) {
+        tx->family = AF_INET;
+        tx->fd = socket(AF_INET, SOCK_DGRAM, 0);
+    }
+    if (tx->fd < 0) {
+        g_printerr("Failed to open transmit socket: %s\n", g_strerror(errno));
+        batch_sender_free(tx);
+        return NULL;
+    }
+    fcntl(tx->fd, F_SETFD, FD_CLOEXEC);
+#ifdef __linux__
+    tx->gso = TRUE;
+#endif
+    return tx;
+}
+
+// Resolve host:port for the sender's socket; IPv4 becomes v4-mapped on the dual-stack socket
+static gboolean batch_sender_resolve(BatchSender *tx, const gchar *host, gint port, TxDestination *out) {
+    struct addrinfo hints;
+    struct addrinfo *result = NULL;
+    gchar service[8];
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = tx->family == AF_INET ? AF_INET : AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags = AI_NUMERICSERV;
+    g_snprintf(service, sizeof(service), "%d", port);
+
+    int rc = getaddrinfo(host, service, &hints, &result);
+    if (rc != 0 || !result) {
+        g_printerr("Cannot resolve destination %s:%d: %s\n", host, port, rc ? gai_strerror(rc) : "no address");
+        return FALSE;
+    }
+
+    memset(out, 0, sizeof(*out));
+    if (result->ai_family == AF_INET && tx->family == AF_INET6) {
+        const struct sockaddr_in *v4 = (const struct sockaddr_in *)result->ai_addr;
+        struct sockaddr_in6 *v6 = (struct sockaddr_in6 *)&out->addr;
+        v6->sin6_family = AF_INET6;
+        v6->sin6_port = v4->sin_port;
+        v6->sin6_addr.s6_addr[10] = 0xff;
+        v6->sin6_addr.s6_addr[11] = 0xff;
+        memcpy(&v6->sin6_addr.s6_addr[12], &v4->sin_addr, sizeof(v4->sin_addr));
+        out->addr_len = sizeof(*v6);
+    } else {
+        memcpy(&out->addr, result->ai_addr, result->ai_addrlen);
+        out->addr_len = result->ai_addrlen;
+    }
+    freeaddrinfo(result);
+
+    g_strlcpy(out->host, host, sizeof(out->host));
+    out->port = port;
+    return TRUE;
+}
+
+// Counterparts of multiudpsink's "add" and "remove". Called with state_mutex held.
+// Kernel pacing for the whole socket: every destination gets its own copy of the stream,
+// so the cap is the per-stream rate times the destinations. Needs the fq qdisc on the
+// egress interface; elsewhere the option is accepted but ignored. Called with tx->mutex held.
+static void batch_sender_apply_pacing(BatchSender *tx) {
+#ifdef SO_MAX_PACING_RATE
+    guint64 bytes_per_sec = (guint64)tx->pacing_kbps * 1000 / 8 * MAX(tx->num_destinations, 1);
+    guint rate = tx->pacing_kbps ? (guint)MIN(bytes_per_sec, G_MAXUINT) : G_MAXUINT;
+    if (setsockopt(tx->fd, SOL_SOCKET, SO_MAX_PACING_RATE, &rate, sizeof(rate)) < 0) {
+        g_printerr("SO_MAX_PACING_RATE failed: %s\n", g_strerror(errno));
+    }
+#else
+    (void)tx;
+#endif
+}
+
+static void batch_sender_add(BatchSender *tx, const gchar *host, gint port) {
+    TxDestination destination;
+    if (!batch_sender_resolve(tx, host, port, &destination)) {
+        return;
+    }
+    g_mutex_lock(&tx->mutex);
+    if (tx->num_destinations < G_N_ELEMENTS(tx->destinations)) {
+        tx->destinations[tx->num_destinations++] = destination;
+        if (tx->pacing_kbps) {
+            batch_sender_apply_pacing(tx);
+        }
+    }
+    g_mutex_unlock(&tx->mutex);
+}
+
+static void batch_sender_remove(BatchSender *tx, const gchar *host, gint port) {
+    g_mutex_lock(&tx->mutex);
+    for (guint i = 0; i < tx->num_destinations; i++) {
+        if (tx->destinations[i].port == port && g_ascii_strcasecmp(tx->destinations[i].host, host) == 0) {
+            memmove(&tx->destinations[i], &tx->destinations[i + 1],
+                    (tx->num_destinations - i - 1) * sizeof(TxDestination));
+            tx->num_destinations--;
+            if (tx->pacing_kbps) {
+                batch_sender_apply_pacing(tx);
+            }
+            break;
+        }
+    }
+    g_mutex_unlock(&tx->mutex);
+}
+
+static void batch_sender_get_stats(BatchSender *tx, const gchar *host, gint port,
+                                   uint64_t *bytes_sent, uint64_t *packets_sent) {
+    g_mutex_lock(&tx->mutex);
+    for (guint i = 0; i < tx->num_destinations; i++) {
+        if (tx->destinations[i].port == port && g_ascii_strcasecmp(tx->destinations[i].host, host) == 0) {
+            *bytes_sent = tx->destinations[i].bytes_sent;
+            *packets_sent = tx->destinations[i].packets_sent;
+            break;
+        }
+    }
+    g_mutex_unlock(&tx->mutex);
+}
+
+#ifdef __linux__
+// One sendmmsg() for the whole batch and every destination. Consecutive packets of the same
+// size (the last of a run may be shorter) share one message segmented by UDP GSO.
+// Called with tx->mutex held; returns the number of system calls made.
+static guint batch_sender_send(BatchSender *tx, struct iovec *iov, const gsize *sizes, guint count) {
+    guint run_start[TX_BATCH_MAX_PACKETS];
+    guint run_length[TX_BATCH_MAX_PACKETS];
+    guint runs = 0;
+
+    for (guint i = 0; i < count;) {
+        guint length = 1;
+        gsize bytes = sizes[i];
+        while (tx->gso && i + length < count && sizes[i + length] <= sizes[i] &&
+               bytes + sizes[i + length] <= TX_GSO_MAX_BYTES) {
+            bytes += sizes[i + length];
+            length++;
+            if (sizes[i + length - 1] < sizes[i]) {
+                break;      // a shorter packet can only end a run
+            }
+        }
+        run_start[runs] = i;
+        run_length[runs] = length;
+        runs++;
+        i += length;
+    }
+
+    guint n = 0;
+    for (guint d = 0; d < tx->num_destinations; d++) {
+        for (guint r = 0; r < runs; r++) {
+            struct msghdr *hdr = &tx->messages[n].msg_hdr;
+            memset(hdr, 0, sizeof(*hdr));
+            hdr->msg_name = &tx->destinations[d].addr;
+            hdr->msg_namelen = tx->destinations[d].addr_len;
+            hdr->msg_iov = &iov[run_start[r]];
+            hdr->msg_iovlen = run_length[r];
+            if (run_length[r] > 1) {
+                hdr->msg_control = tx->control[r].buffer;
+                hdr->msg_controllen = sizeof(tx->control[r].buffer);
+                struct cmsghdr *cmsg = CMSG_FIRSTHDR(hdr);
+                cmsg->cmsg_level = SOL_UDP;
+                cmsg->cmsg_type = UDP_SEGMENT;
+                cmsg->cmsg_len = CMSG_LEN(sizeof(guint16));
+                guint16 segment = (guint16)sizes[run_start[r]];
+                memcpy(CMSG_DATA(cmsg), &segment, sizeof(segment));
+            }
+            tx->message_destination[n] = (guint8)d;
+            tx->message_packets[n] = (guint8)run_length[r];
+            n++;
+        }
+    }
+
+    guint syscalls = 0;
+    guint sent = 0;
+    guint gso_sends = 0;
+    while (sent < n) {
+        int rc = sendmmsg(tx->fd, &tx->messages[sent], MIN(n - sent, TX_SENDMMSG_MAX), 0);
+        syscalls++;
+        if (rc < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (tx->gso && sent == 0 && tx->message_packets[sent] > 1 &&
+                (errno == EIO || errno == EINVAL || errno == ENOPROTOOPT)) {
+                // No UDP GSO on this kernel or route (it needs checksum offload): resend plainly
+                g_printerr("UDP GSO unavailable (%s), batching without it\n", g_strerror(errno));
+                tx->gso = FALSE;
+                return syscalls + batch_sender_send(tx, iov, sizes, count);
+            }
+            if (errno == ENOBUFS) {
+                atomic_fetch_add_explicit(&tx->stats->tx_enobufs, tx->message_packets[sent], memory_order_relaxed);
+            }
+            sent++;         // drop the message the kernel refused and carry on with the rest
+            continue;
+        }
+        for (guint m = sent; m < sent + (guint)rc; m++) {
+            TxDestination *destination = &tx->destinations[tx->message_destination[m]];
+            destination->bytes_sent += tx->messages[m].msg_len;
+            destination->packets_sent += tx->message_packets[m];
+            if (tx->message_packets[m] > 1) {
+                gso_sends++;
+            }
+        }
+        sent += rc;
+    }
+
+    atomic_fetch_add_explicit(&tx->stats->tx_gso_sends, gso_sends, memory_order_relaxed);
+    return syscalls;
+}
+#else
+// Portable fallback: one sendmsg() per packet and destination
+static guint batch_sender_send(BatchSender *tx, struct iovec *iov, const gsize *sizes, guint count) {
+    guint syscalls = 0;
+    for (guint d = 0; d < tx->num_destinations; d++) {
+        TxDestination *destination = &tx->destinations[d];
+        for (guint i = 0; i < count; i++) {
+            struct msghdr hdr;
+            memset(&hdr, 0, sizeof(hdr));
+            hdr.msg_name = &destination->addr;
+            hdr.msg_namelen = destination->addr_len;
+            hdr.msg_iov = &iov[i];
+            hdr.msg_iovlen = 1;
+            syscalls++;
+            if (sendmsg(tx->fd, &hdr, 0) >= 0) {
+                destination->bytes_sent += sizes[i];
+                destination->packets_sent++;
+            } else if (errno == ENOBUFS) {
+                atomic_fetch_add_explicit(&tx->stats->tx_enobufs, 1, memory_order_relaxed);
+            }
+        }
+    }
+    return syscalls;
+}
+#endif
+
+// Send the pending packets and release them. Appsink streaming thread.
+static void batch_sender_flush(BatchSender *tx) {
+    GstBuffer *buffers[TX_BATCH_MAX_PACKETS];
+    GstMapInfo maps[TX_BATCH_MAX_PACKETS];
+    struct iovec iov[TX_BATCH_MAX_PACKETS];
+    gsize sizes[TX_BATCH_MAX_PACKETS];
+    guint count = 0;
+
+    for (guint i = 0; i < tx->pending_count; i++) {
+        if (gst_buffer_map(tx->pending[i], &maps[count], GST_MAP_READ)) {
+            buffers[count] = tx->pending[i];
+            iov[count].iov_base = maps[count].data;
+            iov[count].iov_len = maps[count].size;
+            sizes[count] = maps[count].size;
+            count++;
+        }
+    }
+
+    if (count > 0) {
+        g_mutex_lock(&tx->mutex);
+        guint syscalls = batch_sender_send(tx, iov, sizes, count);
+        g_mutex_unlock(&tx->mutex);
+        atomic_fetch_add_explicit(&tx->stats->tx_syscalls, syscalls, memory_order_relaxed);
+        atomic_fetch_add_explicit(&tx->stats->tx_batches, 1, memory_order_relaxed);
+    }
+
+    for (guint i = 0; i < count; i++) {
+        gst_buffer_unmap(buffers[i], &maps[i]);
+    }
+    for (guint i = 0; i < tx->pending_count; i++) {
+        gst_buffer_unref(tx->pending[i]);
+    }
+    tx->pending_count = 0;
+}
+
+// Hold packets until the RTP marker ends the access unit. Anything that is not H.264
+// media (ULPFEC, RTX) goes straight out instead of waiting for the next frame.
+static void batch_sender_queue(BatchSender *tx, GstBuffer *buffer) {
+    guint8 header[2];
+
+    tx->pending[tx->pending_count++] = gst_buffer_ref(buffer);
+    if (tx->pending_count == TX_BATCH_MAX_PACKETS ||
+        gst_buffer_extract(buffer, 0, header, sizeof(header)) != sizeof(header) ||
+        (header[1] & 0x80) || (header[1] & 0x7f) != H264_PAYLOAD_TYPE) {
+        batch_sender_flush(tx);
+    }
+}
+
+static GstFlowReturn batch_sink_new_sample(GstAppSink *sink, gpointer user_data) {
+    BatchSender *tx = (BatchSender *)user_data;
+    GstSample *sample = gst_app_sink_pull_sample(sink);
+    if (!sample) {
+        return GST_FLOW_FLUSHING;
+    }
+
+    GstBufferList *list = gst_sample_get_buffer_list(sample);
+    if (list) {
+        guint length = gst_buffer_list_length(list);
+        for (guint i = 0; i < length; i++) {
+            batch_sender_queue(tx, gst_buffer_list_get(list, i));
+        }
+    } else if (gst_sample_get_buffer(sample)) {
+        batch_sender_queue(tx, gst_sample_get_buffer(sample));
+    }
+
+    gst_sample_unref(sample);
+    return GST_FLOW_OK;
+}
+
+// ==================== End of Batched Transmit ====================
+
+static void destination_free(gpointer ptr) {
+    Destination *destination = (Destination *)ptr;
+    g_free(destination->host);
+    g_free(destination);
+}
+
+// Index of host:port in data->destinations, or -1. Called with state_mutex held.
+static gint find_destination(CustomData *data, const gchar *host, gint port) {
+    for (guint i = 0; i < data->destinations->len; i++) {
+        const Destination *destination = g_ptr_array_index(data->destinations, i);
+        if (destination->port == port && g_ascii_strcasecmp(destination->host, host) == 0) {
+            return (gint)i;
+        }
+    }
+    return -1;
+}
+
+// multiudpsink's "add"/"remove" signals, or the batched transmitter's equivalent
+static void branch_sink_destination(EncodeBranch *branch, const gchar *signal, const gchar *host, gint port) {
+    if (branch->tx) {
+        if (strcmp(signal, "add") == 0) {
+            batch_sender_add(branch->tx, host, port);
+        } else {
+            batch_sender_remove(branch->tx, host, port);
+        }
+    } else if (branch->sink) {
+        g_signal_emit_by_name(branch->sink, signal, host, port);
+    }
+}
+
+// Give a new media sink the primary destination and every extra one. Called with state_mutex held.
+static void add_sink_destinations(CustomData *data, EncodeBranch *branch) {
+    branch_sink_destination(branch, "add", data->config.host, data->config.port);
+    for (guint i = 0; i < data->destinations->len; i++) {
+        const Destination *destination = g_ptr_array_index(data->destinations, i);
+        branch_sink_destination(branch, "add", destination->host, destination->port);
+    }
+}
+
+// Add or remove one client on every live media sink. Called with state_mutex held.
+static void update_sink_destination(CustomData *data, const gchar *signal, const gchar *host, gint port) {
+    EncodeBranch *branches[] = {data->active_branch, data->standby_branch};
+    for (gsize i = 0; i < G_N_ELEMENTS(branches); i++) {
+        if (branches[i]) {
+            branch_sink_destination(branches[i], signal, host, port);
+        }
+    }
+}
+
+// Point the running pipeline at config.host:config.port after it changed from old_host:old_port.
+// The media sinks swap their primary client, the FEC and RTCP sinks are retargeted, and the
+// encoder is asked for an IDR so the new receiver can start decoding at once; the time until
+// that IDR leaves the parser is the switch latency. Returns FALSE when the RTCP socket has to
+// be reopened (local port or address family changes), which takes a rebuild.
+// Called with state_mutex held.
+static gboolean switch_destination(CustomData *data, const gchar *old_host, gint old_port) {
+    const gchar *host = data->config.host;
+    gint port = data->config.port;
+
+    if (!data->pipeline || !data->active_branch ||
+        (old_port == port && g_strcmp0(old_host, host) == 0)) {
+        return TRUE;
+    }
+
+    if (data->rtcp.rtcp_sink) {
+        GSocketFamily old_family = host_family(old_host);
+        GSocketFamily new_family = host_family(host);
+        if ((data->config.rtcp_port == 0 && old_port != port) ||
+            (old_family != G_SOCKET_FAMILY_INVALID && new_family != G_SOCKET_FAMILY_INVALID &&
+             old_family != new_family)) {
+            g_print("Destination %s:%d needs a new RTCP socket, rebuilding pipeline\n", host, port);
+            return FALSE;
+        }
+        g_object_set(data->rtcp.rtcp_sink, "host", host, "port", rtcp_port_for(&data->config), NULL);
+    }
+
+    // The media sinks also carry the extra destinations, so only the primary client moves
+    update_sink_destination(data, "remove", old_host, old_port);
+    update_sink_destination(data, "add", host, port);
+
+    EncodeBranch *branches[] = {data->active_branch, data->standby_branch};
+    for (gsize i = 0; i < G_N_ELEMENTS(branches); i++) {
+        if (branches[i] && branches[i]->fec_sink) {
+            g_object_set(branches[i]->fec_sink, "host", host, "port", port + ST2022_FEC_PORT_OFFSET, NULL);
+        }
+    }
+
+    // A new route may go out over another interface
+    if (data->config.rtp_mtu <= 0) {
+        update_packetization(data);
+    }
+
+    atomic_store(&data->stats.switch_started, g_get_monotonic_time());
+    gst_element_send_event(data->active_branch->encoder,
+                           gst_video_event_new_upstream_force_key_unit(GST_CLOCK_TIME_NONE, TRUE, 0));
+
+    g_mutex_lock(&data->stats.stats_mutex);
+    data->stats.destination_switches++;
+    g_mutex_unlock(&data->stats.stats_mutex);
+
+    g_print("Switched UDP destination from %s:%d to %s:%d without pipeline rebuild\n",
+            old_host ? old_host : "", old_port, host, port);
+    return TRUE;
+}
+
+// ==================== Socket QoS ====================
+
+// DSCP, SO_PRIORITY and SO_SNDBUF on the batched transmitter's dual-stack socket.
+// IPv4-mapped destinations take their TOS from IP_TOS, so both are set.
+static void batch_sender_set_qos(BatchSender *tx, gint dscp, gint priority, gint send_buffer_kb) {
+    int tos = dscp << 2;
+    if (tx->family == AF_INET6 && setsockopt(tx->fd, IPPROTO_IPV6, IPV6_TCLASS, &tos, sizeof(tos)) < 0) {
+        g_printerr("IPV6_TCLASS failed: %s\n", g_strerror(errno));
+    }
+    if (setsockopt(tx->fd, IPPROTO_IP, IP_TOS, &tos, sizeof(tos)) < 0 && tx->family == AF_INET) {
+        g_printerr("IP_TOS failed: %s\n", g_strerror(errno));
+    }
+#ifdef SO_PRIORITY
+    // After IP_TOS, which resets the priority from the TOS bits on Linux
+    if (priority > 0 && setsockopt(tx->fd, SOL_SOCKET, SO_PRIORITY, &priority, sizeof(priority)) < 0) {
+        g_printerr("SO_PRIORITY failed: %s\n", g_strerror(errno));
+    }
+#else
+    (void)priority;
+#endif
+    int sndbuf = send_buffer_kb * 1024;
+    if (sndbuf > 0 && setsockopt(tx->fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf)) < 0) {
+        g_printerr("SO_SNDBUF failed: %s\n", g_strerror(errno));
+    }
+}
+
+// The same for a udpsink/multiudpsink. DSCP goes through the element, which marks every
+// socket it has (0 clears the marking; -1 would leave it alone); priority and buffer size
+// are set on the sockets it opened, so this only takes effect once the sink has started.
+static void set_sink_qos(GstElement *sink, gint dscp, gint priority, gint send_buffer_kb) {
+    g_object_set(sink, "qos-dscp", dscp, NULL);
+
+    const gchar *properties[] = {"used-socket", "used-socket-v6"};
+    for (gsize i = 0; i < G_N_ELEMENTS(properties); i++) {
+        GSocket *socket = NULL;
+        g_object_get(sink, properties[i], &socket, NULL);
+        if (!socket) {
+            continue;
+        }
+        GError *error = NULL;
+#ifdef SO_PRIORITY
+        if (priority > 0 && !g_socket_set_option(socket, SOL_SOCKET, SO_PRIORITY, priority, &error)) {
+            g_printerr("SO_PRIORITY on %s failed: %s\n", GST_ELEMENT_NAME(sink), error->message);
+            g_clear_error(&error);
+        }
+#endif
+        if (send_buffer_kb > 0 &&
+            !g_socket_set_option(socket, SOL_SOCKET, SO_SNDBUF, send_buffer_kb * 1024, &error)) {
+            g_printerr("SO_SNDBUF on %s failed: %s\n", GST_ELEMENT_NAME(sink), error->message);
+            g_clear_error(&error);
+        }
+        g_object_unref(socket);
+    }
+#ifndef SO_PRIORITY
+    (void)priority;
+#endif
+}
+
+// Apply the QoS profile to every sending socket of the running pipeline. Called with
+// state_mutex held once the sinks are started and after QoS config changes.
+static void apply_socket_qos(CustomData *data) {
+    const AppConfig *config = &data->config;
+    EncodeBranch *branches[] = {data->active_branch, data->standby_branch};
+
+    for (gsize i = 0; i < G_N_ELEMENTS(branches); i++) {
+        EncodeBranch *branch = branches[i];
+        if (!branch) {
+            continue;
+        }
+        if (branch->tx) {
+            batch_sender_set_qos(branch->tx, config->dscp, config->socket_priority, config->send_buffer_kb);
+        } else {
+            set_sink_qos(branch->sink, config->dscp, config->socket_priority, config->send_buffer_kb);
+        }
+        if (branch->fec_sink) {
+            set_sink_qos(branch->fec_sink, config->dscp, config->socket_priority, config->send_buffer_kb);
+        }
+    }
+    if (data->rtcp.rtcp_sink) {
+        set_sink_qos(data->rtcp.rtcp_sink, config->dscp, config->socket_priority, 0);
     }
+}
 
-    // Save config
-    if (!save_config_to_file(&data->config, data->config_file_path)) {
-        *error_msg = strdup("Failed to save configuration");
-        g_mutex_unlock(&data->state_mutex);
-        return 0;
-    }
+// SndbufErrors from /proc/net/snmp plus Udp6SndbufErrors from /proc/net/snmp6: UDP sends
+// the kernel dropped for lack of socket or qdisc buffer space. The counters cover the
+// whole network namespace, not just this process. Linux only; FALSE elsewhere.
+static gboolean read_udp_sndbuf_errors(guint64 *errors) {
+    gchar *contents = NULL;
+    gboolean found = FALSE;
 
-    // Update UDP sink if only host/port changed
-    if ((needs_host_update || needs_port_update) && !needs_rebuild && data->pipeline) {
-        GstElement *udpsink = gst_bin_get_by_name(GST_BIN(data->pipeline), "udpsink");
-        if (udpsink) {
-            if (needs_host_update) {
-                g_object_set(udpsink, "host", data->config.host, NULL);
+    *errors = 0;
+    if (g_file_get_contents("/proc/net/snmp", &contents, NULL, NULL)) {
+        // "Udp: InDatagrams ... SndbufErrors ..." followed by a line of values in the same order
+        gchar **lines = g_strsplit(contents, "\n", -1);
+        for (gint i = 0; lines[i] && lines[i + 1] && !found; i++) {
+            if (!g_str_has_prefix(lines[i], "Udp: ") || !g_str_has_prefix(lines[i + 1], "Udp: ")) {
+                continue;
             }
-            if (needs_port_update) {
-                g_object_set(udpsink, "port", data->config.port, NULL);
+            gchar **names = g_strsplit(lines[i], " ", -1);
+            gchar **values = g_strsplit(lines[i + 1], " ", -1);
+            for (gint j = 1; names[j] && values[j]; j++) {
+                if (strcmp(names[j], "SndbufErrors") == 0) {
+                    *errors += g_ascii_strtoull(values[j], NULL, 10);
+                    found = TRUE;
+                    break;
+                }
             }
-            gst_object_unref(udpsink);
-            g_print("Updated UDP destination to %s:%d without pipeline rebuild\n",
-                    data->config.host, data->config.port);
+            g_strfreev(names);
+            g_strfreev(values);
+        }
+        g_strfreev(lines);
+        g_free(contents);
+    }
+    if (g_file_get_contents("/proc/net/snmp6", &contents, NULL, NULL)) {
+        const gchar *line = strstr(contents, "Udp6SndbufErrors");
+        if (line) {
+            *errors += g_ascii_strtoull(line + strlen("Udp6SndbufErrors"), NULL, 10);
+            found = TRUE;
         }
+        g_free(contents);
     }
+    return found;
+}
 
-    // Return new config
-    new_config->host = g_strdup(data->config.host);
-    new_config->port = data->config.port;
-    new_config->camera_name = g_strdup(data->config.camera_name);
-    new_config->encoder_type = g_strdup(data->config.encoder_type);
-    new_config->width = data->config.width;
-    new_config->height = data->config.height;
-    new_config->framerate = data->config.framerate;
+// ==================== End of Socket QoS ====================
 
-    if (needs_rebuild) {
-        data->pipeline_is_restarting = TRUE;
-    }
+// ==================== Pacing ====================
 
-    g_mutex_unlock(&data->state_mutex);
-    return 1;
+static void atomic_max_int64(atomic_int_fast64_t *target, gint64 value) {
+    int_fast64_t current = atomic_load_explicit(target, memory_order_relaxed);
+    while (value > current && !atomic_compare_exchange_weak(target, &current, value)) {
+    }
 }
 
-// Swap resolution callback
-static int grpc_swap_resolution_cb(void* user_data, int swap, grpc_config_t* new_config,
-                                    char** error_msg) {
-    CustomData *data = (CustomData*)user_data;
-    gboolean persisted = FALSE;
+// Packets entering the pace queue, for the queue depth stats
+static GstPadProbeReturn
+pace_queue_input_probe_callback (GstPad *pad __attribute__((unused)), GstPadProbeInfo *info, gpointer user_data)
+{
+    StreamStats *stats = (StreamStats *)user_data;
+    gint packets = 1;
 
-    if (!swap_config_resolution(data, swap, &persisted)) {
-        *error_msg = strdup("Failed to set resolution");
-        return 0;
+    if (info->type & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+        packets = (gint)gst_buffer_list_length(GST_PAD_PROBE_INFO_BUFFER_LIST(info));
+    }
+    gint depth = atomic_fetch_add_explicit(&stats->pacing_queued, packets, memory_order_relaxed) + packets;
+    gint max = atomic_load_explicit(&stats->pacing_queued_max, memory_order_relaxed);
+    while (depth > max && !atomic_compare_exchange_weak(&stats->pacing_queued_max, &max, depth)) {
     }
+    return GST_PAD_PROBE_OK;
+}
 
-    g_mutex_lock(&data->state_mutex);
-    new_config->host = g_strdup(data->config.host);
-    new_config->port = data->config.port;
-    new_config->camera_name = g_strdup(data->config.camera_name);
-    new_config->encoder_type = g_strdup(data->config.encoder_type);
-    new_config->width = data->config.width;
-    new_config->height = data->config.height;
-    new_config->framerate = data->config.framerate;
-    g_mutex_unlock(&data->state_mutex);
+// Waits on the pace queue's streaming thread until the bucket has room for the packet.
+// rtph264pay pushes the FU-A fragments of a NAL as one list; those are pushed on one at
+// a time through this probe so a keyframe is spread out instead of sent in one go.
+static GstPadProbeReturn
+pacer_probe_callback (GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+    EncodeBranch *branch = (EncodeBranch *)user_data;
+    StreamStats *stats = &branch->owner->stats;
+    Pacer *pacer = &branch->pacer;
+
+    if (info->type & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+        GstBufferList *list = GST_PAD_PROBE_INFO_BUFFER_LIST(info);
+        guint length = gst_buffer_list_length(list);
+        GstFlowReturn ret = GST_FLOW_OK;
+        guint i = 0;
+        for (; i < length && ret == GST_FLOW_OK; i++) {
+            ret = gst_pad_push(pad, gst_buffer_ref(gst_buffer_list_get(list, i)));
+        }
+        atomic_fetch_sub_explicit(&stats->pacing_queued, (gint)(length - i), memory_order_relaxed);
+        gst_buffer_list_unref(list);
+        GST_PAD_PROBE_INFO_FLOW_RETURN(info) = ret;
+        return GST_PAD_PROBE_HANDLED;
+    }
 
-    return 1;
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    atomic_fetch_sub_explicit(&stats->pacing_queued, 1, memory_order_relaxed);
+    guint rate_kbps = atomic_load_explicit(&pacer->rate_kbps, memory_order_relaxed);
+    if (!buffer || rate_kbps == 0) {
+        return GST_PAD_PROBE_OK;
+    }
+
+    gint64 now = g_get_monotonic_time();
+    pacer->next_send = MAX(pacer->next_send, now - PACER_BURST_USEC);
+    gint64 wait = pacer->next_send - now;
+    if (wait > atomic_load_explicit(&pacer->max_delay_usec, memory_order_relaxed)) {
+        atomic_fetch_add_explicit(&stats->pacing_overruns, 1, memory_order_relaxed);
+        pacer->next_send = now;
+        wait = 0;
+    }
+    if (wait > 0) {
+        g_usleep(wait);
+        atomic_fetch_add_explicit(&stats->pacing_delay_usec, wait, memory_order_relaxed);
+        atomic_max_int64(&stats->pacing_delay_max_usec, wait);
+    }
+    pacer->next_send += (gint64)gst_buffer_get_size(buffer) * 8 * 1000 / rate_kbps;
+    atomic_fetch_add_explicit(&stats->paced_packets, 1, memory_order_relaxed);
+    return GST_PAD_PROBE_OK;
 }
 
-// Update host callback
-static int grpc_update_host_cb(void* user_data, const char* host, char** error_msg) {
-    CustomData *data = (CustomData*)user_data;
+// The batched transmitter's sends already leave as whole frames, so it is paced by the
+// kernel rather than a token bucket; the rate follows its destination count.
+static void batch_sender_set_pacing(BatchSender *tx, guint rate_kbps) {
+    g_mutex_lock(&tx->mutex);
+    tx->pacing_kbps = rate_kbps;
+    batch_sender_apply_pacing(tx);
+    g_mutex_unlock(&tx->mutex);
+}
 
-    g_mutex_lock(&data->state_mutex);
-    g_free(data->config.host);
-    data->config.host = g_strdup(host);
+// Follow the bitrate target and pacing config. Called with state_mutex held.
+static void update_pacing(CustomData *data) {
+    guint rate_kbps = data->config.pacing_factor > 0.0
+        ? (guint)(data->config.pacing_factor * data->bitrate.target_kbps) : 0;
+    EncodeBranch *branches[] = {data->active_branch, data->standby_branch};
 
-    if (!save_config_to_file(&data->config, data->config_file_path)) {
-        *error_msg = strdup("Failed to save configuration");
-        g_mutex_unlock(&data->state_mutex);
-        return 0;
+    for (gsize i = 0; i < G_N_ELEMENTS(branches); i++) {
+        EncodeBranch *branch = branches[i];
+        if (!branch) {
+            continue;
+        }
+        atomic_store(&branch->pacer.rate_kbps, rate_kbps);
+        atomic_store(&branch->pacer.max_delay_usec, data->config.pacing_max_delay_ms * 1000);
+        if (branch->tx) {
+            batch_sender_set_pacing(branch->tx, rate_kbps);
+        }
     }
+}
 
-    // Update UDP sink if pipeline exists
-    if (data->pipeline) {
-        GstElement *udpsink = gst_bin_get_by_name(GST_BIN(data->pipeline), "udpsink");
-        if (udpsink) {
-            g_object_set(udpsink, "host", data->config.host, NULL);
-            gst_object_unref(udpsink);
-            g_print("Updated UDP host to %s\n", data->config.host);
+// ==================== End of Pacing ====================
+
+// Counts packets leaving a FEC encoder. For ULPFEC the repair packets are interleaved
+// with the media, so only the FEC payload type is counted.
+static GstPadProbeReturn
+fec_output_probe_callback (GstPad *pad __attribute__((unused)), GstPadProbeInfo *info, gpointer user_data)
+{
+    EncodeBranch *branch = (EncodeBranch *)user_data;
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    StreamStats *stats = &branch->owner->stats;
+
+    if (!buffer) {
+        return GST_PAD_PROBE_OK;
+    }
+    if (!branch->fec_sink) {
+        guint8 header[2];
+        if (gst_buffer_extract(buffer, 0, header, sizeof(header)) != sizeof(header) ||
+            (header[1] & 0x7f) != ULPFEC_PAYLOAD_TYPE) {
+            return GST_PAD_PROBE_OK;
         }
     }
+    atomic_fetch_add_explicit(&stats->fec_packets, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stats->fec_bytes, gst_buffer_get_size(buffer), memory_order_relaxed);
+    return GST_PAD_PROBE_OK;
+}
 
-    g_mutex_unlock(&data->state_mutex);
-    return 1;
+// Create the branch's FEC encoder (and the column FEC sink for SMPTE 2022-1) per config.
+// Elements are left unparented for create_encode_branch() to add and link.
+static gboolean create_fec_elements(CustomData *data, EncodeBranch *branch) {
+    const gchar *mode = data->config.fec;
+    gint percentage = CLAMP(data->config.fec_percentage, 1, 100);
+    gchar *name;
+
+    if (!mode || strcmp(mode, "none") == 0) {
+        return TRUE;
+    }
+
+    if (strcmp(mode, "ulpfec") == 0) {
+        name = branch_element_name("fec", branch->generation);
+        branch->fec = gst_element_factory_make("rtpulpfecenc", name);
+        g_free(name);
+        if (!branch->fec) {
+            g_printerr("Failed to create rtpulpfecenc element.\n");
+            return FALSE;
+        }
+        g_object_set(branch->fec, "pt", ULPFEC_PAYLOAD_TYPE, "percentage", percentage, NULL);
+        g_print("ULPFEC enabled: %d%% overhead, PT %d\n", percentage, ULPFEC_PAYLOAD_TYPE);
+    } else {
+        name = branch_element_name("fec", branch->generation);
+        branch->fec = gst_element_factory_make("rtpst2022-1-fecenc", name);
+        g_free(name);
+        name = branch_element_name("fec_sink", branch->generation);
+        branch->fec_sink = gst_element_factory_make("udpsink", name);
+        g_free(name);
+        if (!branch->fec || !branch->fec_sink) {
+            g_printerr("Failed to create rtpst2022-1-fecenc/udpsink elements.\n");
+            return FALSE;
+        }
+        // Column FEC only: one parity packet per column of D rows gives 1/D overhead and
+        // repairs bursts of up to L packets. SMPTE 2022-1 limits L*D to 100.
+        gint rows = CLAMP((100 + percentage / 2) / percentage, 4, 20);
+        gint columns = MIN(rows, 100 / rows);
+        g_object_set(branch->fec,
+                     "rows", rows,
+                     "columns", columns,
+                     "enable-column-fec", TRUE,
+                     "enable-row-fec", FALSE,
+                     NULL);
+        g_object_set(branch->fec_sink, "host", data->config.host,
+                     "port", data->config.port + ST2022_FEC_PORT_OFFSET,
+                     "sync", FALSE, "async", FALSE, NULL);
+        g_print("SMPTE 2022-1 column FEC enabled: %dx%d matrix to port %d\n", columns, rows,
+                data->config.port + ST2022_FEC_PORT_OFFSET);
+    }
+
+    return TRUE;
 }
 
-// Get available devices callback
-static void grpc_get_devices_cb(void* user_data, grpc_devices_t* devices) {
-    // List available cameras
-    GList *camera_list = NULL;
-    GstDeviceMonitor *monitor = gst_device_monitor_new();
-    GstCaps *caps = gst_caps_new_empty_simple("video/x-raw");
-    gst_device_monitor_add_filter(monitor, "Video/Source", caps);
-    gst_caps_unref(caps);
+// Build the encode chain inside data->pipeline, preceded by a queue when the branch is fed
+// from the capture tee. Takes ownership of the encoder. Called with state_mutex held;
+// returns NULL with nothing left in the bin on failure.
+static EncodeBranch* create_encode_branch(CustomData *data, GstElement *encoder, const gchar *encoder_name,
+                                          guint generation, gboolean from_tee, gboolean gate_open) {
+    EncodeBranch *branch = g_new0(EncodeBranch, 1);
+    branch->owner = data;
+    branch->generation = generation;
+    branch->encoder = encoder;
+    branch->encoder_name = g_strdup(encoder_name);
+    branch->gate_open = gate_open ? 1 : 0;
+
+    gchar *name;
+    if (from_tee) {
+        name = branch_element_name("branch_queue", generation);
+        branch->queue = gst_element_factory_make("queue", name);
+        g_free(name);
+        if (!branch->queue) {
+            g_printerr("Failed to create branch queue.\n");
+            goto error;
+        }
+        // Hold at most two raw frames and drop the oldest, so neither branch can stall
+        // the camera's buffer pool or its sibling
+        g_object_set(branch->queue,
+                     "max-size-buffers", 2,
+                     "max-size-bytes", 0,
+                     "max-size-time", (guint64)0,
+                     NULL);
+        gst_util_set_object_arg(G_OBJECT(branch->queue), "leaky", "downstream");
+    }
 
-    if (gst_device_monitor_start(monitor)) {
-        camera_list = gst_device_monitor_get_devices(monitor);
-        gst_device_monitor_stop(monitor);
+    // Add caps filter after encoder to match the old working pipeline
+    name = branch_element_name("encoder_caps", generation);
+    branch->encoder_caps = gst_element_factory_make("capsfilter", name);
+    g_free(name);
+    if (!branch->encoder_caps) {
+        g_printerr("Failed to create encoder caps filter.\n");
+        goto error;
     }
+    GstCaps *h264_caps = gst_caps_new_simple("video/x-h264",
+                                             "level", G_TYPE_STRING, "4",
+                                             NULL);
+    g_object_set(branch->encoder_caps, "caps", h264_caps, NULL);
+    gst_caps_unref(h264_caps);
 
-    // Count cameras
-    devices->num_cameras = g_list_length(camera_list);
-    devices->cameras = malloc(sizeof(grpc_camera_info_t) * devices->num_cameras);
+    name = branch_element_name("parser", generation);
+    branch->parser = gst_element_factory_make("h264parse", name);
+    g_free(name);
+    if (!branch->parser) {
+        g_printerr("Failed to create h264parse element.\n");
+        goto error;
+    }
+
+    name = branch_element_name("payloader", generation);
+    branch->payloader = gst_element_factory_make("rtph264pay", name);
+    g_free(name);
+    if (!branch->payloader) {
+        g_printerr("Failed to create rtph264pay element.\n");
+        goto error;
+    }
+    g_object_set(branch->payloader, "config-interval", -1, "pt", H264_PAYLOAD_TYPE, NULL);
+    set_payloader_packetization(branch->payloader, resolve_rtp_mtu(data), data->config.rtp_aggregate);
 
-    GList *l;
-    int i = 0;
-    for (l = camera_list; l != NULL; l = l->next) {
-        GstDevice *device = (GstDevice *)l->data;
-        gchar *name = gst_device_get_display_name(device);
-        gchar *path = gst_device_get_device_class(device);
+    if (!create_fec_elements(data, branch)) {
+        goto error;
+    }
 
-        devices->cameras[i].name = strdup(name ? name : "Unknown");
-        devices->cameras[i].path = strdup(path ? path : "");
+    gboolean batched = g_strcmp0(data->config.tx_mode, "batched") == 0;
+    name = branch_element_name("sink", generation);
+    branch->sink = gst_element_factory_make(batched ? "appsink" : "multiudpsink", name);
+    g_free(name);
+    if (!branch->sink) {
+        g_printerr("Failed to create %s element.\n", batched ? "appsink" : "multiudpsink");
+        goto error;
+    }
 
+    g_print("Configuring %s sink: %s:%d (+%u destinations)\n", batched ? "batched UDP" : "UDP",
+            data->config.host, data->config.port, data->destinations->len);
+    g_object_set(branch->sink, "sync", FALSE, "async", FALSE, NULL);
+    if (batched) {
+        branch->tx = batch_sender_new(&data->stats);
+        if (!branch->tx) {
+            goto error;
+        }
+        // Payloader lists (FU-A fragments of one NAL) arrive as one sample where supported
+        if (g_object_class_find_property(G_OBJECT_GET_CLASS(branch->sink), "buffer-list")) {
+            g_object_set(branch->sink, "buffer-list", TRUE, NULL);
+        }
+        GstAppSinkCallbacks callbacks = { .new_sample = batch_sink_new_sample };
+        gst_app_sink_set_callbacks(GST_APP_SINK(branch->sink), &callbacks, branch->tx, NULL);
+    }
+    add_sink_destinations(data, branch);
+
+    // The batched transmitter is paced by the kernel; multiudpsink gets a token bucket
+    guint pacing_kbps = data->config.pacing_factor > 0.0
+        ? (guint)(data->config.pacing_factor * data->bitrate.target_kbps) : 0;
+    atomic_store(&branch->pacer.rate_kbps, pacing_kbps);
+    atomic_store(&branch->pacer.max_delay_usec, data->config.pacing_max_delay_ms * 1000);
+    if (pacing_kbps && branch->tx) {
+        batch_sender_set_pacing(branch->tx, pacing_kbps);
+    } else if (pacing_kbps) {
+        name = branch_element_name("pace_queue", generation);
+        branch->pace_queue = gst_element_factory_make("queue", name);
         g_free(name);
-        g_free(path);
-        gst_object_unref(device);
-        i++;
+        if (!branch->pace_queue) {
+            g_printerr("Failed to create pace queue element.\n");
+            goto error;
+        }
+        g_object_set(branch->pace_queue, "max-size-buffers", 0, "max-size-bytes", 0, "max-size-time", (guint64)0, NULL);
+        g_print("Pacing at %u kbps (%.2fx target), at most %d ms added delay\n", pacing_kbps,
+                data->config.pacing_factor, data->config.pacing_max_delay_ms);
+
+        GstPad *queue_pad = gst_element_get_static_pad(branch->pace_queue, "sink");
+        gst_pad_add_probe(queue_pad, GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+                          pace_queue_input_probe_callback, &data->stats, NULL);
+        gst_object_unref(queue_pad);
+        queue_pad = gst_element_get_static_pad(branch->pace_queue, "src");
+        gst_pad_add_probe(queue_pad, GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+                          pacer_probe_callback, branch, NULL);
+        gst_object_unref(queue_pad);
     }
-    g_list_free(camera_list);
-    gst_object_unref(monitor);
 
-    // List available encoders
-    const char *encoder_names[] = {"v4l2h264enc", "omxh264enc", "x264enc", "nvh264enc", "vaapih264enc", NULL};
-    int encoder_count = 0;
+    // Add probe to monitor data flow for statistics
+    GstPad *pad = gst_element_get_static_pad(branch->sink, "sink");
+    if (pad) {
+        gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+                          udpsink_probe_callback, data, NULL);
+        if (!branch->tx) {
+            gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+                              multiudpsink_send_probe_callback, &data->stats, NULL);
+        }
+        gst_object_unref(pad);
+    }
 
-    // Count available encoders
-    for (int j = 0; encoder_names[j] != NULL; j++) {
-        GstElementFactory *factory = gst_element_factory_find(encoder_names[j]);
-        if (factory) {
-            encoder_count++;
-            gst_object_unref(factory);
+    pad = gst_element_get_static_pad(branch->encoder, "sink");
+    if (pad) {
+        gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, encoder_input_probe_callback, data, NULL);
+        gst_object_unref(pad);
+    }
+
+    pad = gst_element_get_static_pad(branch->payloader, "src");
+    if (pad) {
+        gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+                          branch_gate_probe_callback, branch, NULL);
+        gst_object_unref(pad);
+    }
+
+    if (branch->fec) {
+        pad = branch->fec_sink ? gst_element_get_static_pad(branch->fec_sink, "sink")
+                               : gst_element_get_static_pad(branch->fec, "src");
+        if (pad) {
+            gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, fec_output_probe_callback, branch, NULL);
+            gst_object_unref(pad);
         }
     }
 
-    devices->num_encoders = encoder_count;
-    devices->encoders = malloc(sizeof(grpc_encoder_info_t) * devices->num_encoders);
+    if (branch->queue) {
+        add_latency_probe(data, branch->queue, "src", LATENCY_STAGE_QUEUE, &branch->gate_open);
+    }
+    add_latency_probe(data, branch->encoder, "src", LATENCY_STAGE_ENCODER, &branch->gate_open);
+    add_latency_probe(data, branch->parser, "src", LATENCY_STAGE_PARSER, &branch->gate_open);
+    add_latency_probe(data, branch->payloader, "src", LATENCY_STAGE_PAYLOADER, &branch->gate_open);
+    add_latency_probe(data, branch->sink, "sink", LATENCY_STAGE_SINK, &branch->gate_open);
+    if (gate_open) {
+        name_branch_latency_stages(data, branch);
+    }
 
-    int enc_idx = 0;
-    for (int j = 0; encoder_names[j] != NULL; j++) {
-        GstElementFactory *factory = gst_element_factory_find(encoder_names[j]);
-        if (factory) {
-            devices->encoders[enc_idx].name = strdup(encoder_names[j]);
-            devices->encoders[enc_idx].available = 1;
-            gst_object_unref(factory);
-            enc_idx++;
+    pad = gst_element_get_static_pad(branch->parser, "src");
+    if (pad) {
+        // A standby branch opens its gate on its first IDR, so that probe has to run first
+        if (!gate_open) {
+            gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, standby_keyframe_probe_callback, branch, NULL);
+        }
+        gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+                          parser_output_probe_callback, branch, NULL);
+        gst_object_unref(pad);
+    }
+
+    gst_bin_add_many(GST_BIN(data->pipeline), branch->encoder, branch->encoder_caps, branch->parser,
+                     branch->payloader, branch->sink, NULL);
+    if (branch->queue) {
+        gst_bin_add(GST_BIN(data->pipeline), branch->queue);
+    }
+    if (branch->fec) {
+        gst_bin_add(GST_BIN(data->pipeline), branch->fec);
+    }
+    if (branch->fec_sink) {
+        gst_bin_add(GST_BIN(data->pipeline), branch->fec_sink);
+    }
+    if (branch->pace_queue) {
+        gst_bin_add(GST_BIN(data->pipeline), branch->pace_queue);
+    }
+
+    // RTP leaves through the FEC encoder when there is one and reaches the network
+    // through the pace queue when pacing
+    GstElement *rtp_out = branch->fec ? branch->fec : branch->payloader;
+    GstElement *net_in = branch->pace_queue ? branch->pace_queue : branch->sink;
+    gboolean linked = gst_element_link_many(branch->encoder, branch->encoder_caps, branch->parser,
+                                            branch->payloader, NULL);
+    if (linked && branch->fec) {
+        linked = gst_element_link(branch->payloader, branch->fec);
+    }
+    if (linked && branch->fec_sink) {
+        linked = gst_element_link_pads(branch->fec, "fec_0", branch->fec_sink, "sink");
+    }
+    if (linked) {
+        linked = data->rtcp.rtpbin ? link_rtcp_session(data, rtp_out, net_in)
+                                   : gst_element_link(rtp_out, net_in);
+    }
+    if (linked && branch->pace_queue) {
+        linked = gst_element_link(branch->pace_queue, branch->sink);
+    }
+    if (linked && branch->queue) {
+        linked = gst_element_link(branch->queue, branch->encoder);
+    }
+    if (!linked) {
+        g_printerr("Failed to link encoder branch.\n");
+        GstElement *elements[] = {branch->queue, branch->encoder, branch->encoder_caps,
+                                  branch->parser, branch->payloader, branch->fec,
+                                  branch->fec_sink, branch->pace_queue, branch->sink};
+        for (gsize i = 0; i < G_N_ELEMENTS(elements); i++) {
+            if (elements[i]) {
+                gst_bin_remove(GST_BIN(data->pipeline), elements[i]);
+            }
+        }
+        free_encode_branch(branch);
+        return NULL;
+    }
+
+    return branch;
+
+error:
+    {
+        // Nothing is parented yet; sink the floating refs so the elements are released
+        GstElement *elements[] = {branch->queue, branch->encoder, branch->encoder_caps,
+                                  branch->parser, branch->payloader, branch->fec,
+                                  branch->fec_sink, branch->pace_queue, branch->sink};
+        for (gsize i = 0; i < G_N_ELEMENTS(elements); i++) {
+            if (elements[i]) {
+                gst_object_unref(gst_object_ref_sink(elements[i]));
+            }
         }
     }
+    free_encode_branch(branch);
+    return NULL;
 }
 
-// ==================== End of gRPC Callbacks ====================
+// Detach a branch from the capture tee and drop its elements from the running pipeline.
+// Called with state_mutex held; the branch is freed.
+static void remove_encode_branch(CustomData *data, EncodeBranch *branch) {
+    if (branch->tee_pad) {
+        GstElement *tee = gst_pad_get_parent_element(branch->tee_pad);
+        GstPad *queue_pad = gst_element_get_static_pad(branch->queue, "sink");
+        gst_pad_unlink(branch->tee_pad, queue_pad);
+        gst_object_unref(queue_pad);
+        if (tee) {
+            gst_element_release_request_pad(tee, branch->tee_pad);
+            gst_object_unref(tee);
+        }
+    }
+
+    GstElement *elements[] = {branch->queue, branch->encoder, branch->encoder_caps,
+                              branch->parser, branch->payloader, branch->fec,
+                              branch->fec_sink, branch->pace_queue, branch->sink};
+    for (gsize i = 0; i < G_N_ELEMENTS(elements); i++) {
+        if (elements[i]) {
+            gst_element_set_state(elements[i], GST_STATE_NULL);
+            gst_bin_remove(GST_BIN(data->pipeline), elements[i]);
+        }
+    }
+    free_encode_branch(branch);
+}
 
 static gboolean build_and_run_pipeline(CustomData *data) {
+    gint64 restart_start = g_get_monotonic_time();
+
+    // Detach the old pipeline under the lock, then stop it and wait for the capture
+    // device without holding state_mutex so gRPC and serial requests are not blocked
     g_mutex_lock(&data->state_mutex);
-    g_print("Building pipeline with config: host=%s, port=%d, camera=%s, encoder=%s, %dx%d@%dfps\n",
-            data->config.host, data->config.port, data->config.camera_name, data->config.encoder_type,
-            data->config.width, data->config.height, data->config.framerate);
+    GstElement *old_pipeline = data->pipeline;
+    data->pipeline = NULL;
+    EncodeBranch *old_active = data->active_branch;
+    EncodeBranch *old_standby = data->standby_branch;
+    data->active_branch = NULL;
+    data->standby_branch = NULL;
+    data->standby_started = 0;
+    data->branch_generation = 0;
+    clear_rtcp_session(&data->rtcp);
+    if (data->bus) {
+        gst_object_unref(data->bus);
+        data->bus = NULL;
+    }
+    AppConfig source_config;
+    copy_config(&source_config, &data->config);
+    // Exporting DMABufs is harmless for the copy path, and io-mode can only be set before READY
+    gboolean export_dmabuf = strcmp(source_config.capture_mode, "system") != 0 && !data->dmabuf_import_failed;
+    g_mutex_unlock(&data->state_mutex);
 
-    // Stop and cleanup existing pipeline
-    if (data->pipeline) {
+    if (old_pipeline) {
         g_print("Stopping existing pipeline.\n");
         
         // Set to NULL state and wait for completion
-        GstStateChangeReturn ret = gst_element_set_state(data->pipeline, GST_STATE_NULL);
+        GstStateChangeReturn ret = gst_element_set_state(old_pipeline, GST_STATE_NULL);
         if (ret == GST_STATE_CHANGE_ASYNC) {
             g_print("Waiting for pipeline to stop...\n");
-            ret = gst_element_get_state(data->pipeline, NULL, NULL, 5 * GST_SECOND);
+            ret = gst_element_get_state(old_pipeline, NULL, NULL, 5 * GST_SECOND);
             if (ret == GST_STATE_CHANGE_FAILURE) {
                 g_printerr("Warning: Pipeline stop failed\n");
             }
         }
         
-        gst_object_unref(data->pipeline);
-        data->pipeline = NULL;
-        
-        // Give libcamera time to release the camera resource
-        g_print("Waiting for camera resource to be released...\n");
-        g_usleep(1000000); // Wait 1 second
+        gst_object_unref(old_pipeline);
     }
-    if (data->bus) {
-        gst_object_unref(data->bus);
-        data->bus = NULL;
+    free_encode_branch(old_active);
+    free_encode_branch(old_standby);
+
+    GstElement *src = create_video_source(&source_config);
+    gint64 release_wait = 0;
+    if (src && source_is_device(&source_config)) {
+        if (export_dmabuf && strcmp(source_config.source_type, "v4l2") == 0) {
+            gst_util_set_object_arg(G_OBJECT(src), "io-mode", "dmabuf");
+        }
+        // Open the device now; this returns as soon as the previous pipeline has let go of it
+        release_wait = acquire_source_device(src);
+        if (release_wait < 0) {
+            gst_object_unref(src);
+            src = NULL;
+        }
     }
+    free_config_members(&source_config);
+
+    g_mutex_lock(&data->state_mutex);
+    g_print("Building pipeline with config: host=%s, port=%d, source=%s, camera=%s, encoder=%s, %dx%d@%dfps\n",
+            data->config.host, data->config.port, data->config.source_type,
+            data->config.camera_name, data->config.encoder_type,
+            data->config.width, data->config.height, data->config.framerate);
 
     data->pipeline = gst_pipeline_new("video-stream-pipeline");
     if (!data->pipeline) {
         g_printerr("Failed to create pipeline.\n");
+        if (src) {
+            gst_element_set_state(src, GST_STATE_NULL);
+            gst_object_unref(src);
+        }
         g_mutex_unlock(&data->state_mutex);
         return FALSE;
     }
 
-    GstElement *src, *capsfilter, *convert, *encoder, *encoder_caps, *parser, *payloader, *sink;
+    GstElement *capsfilter, *convert, *tee, *encoder = NULL;
     GstCaps *caps;
+    gchar *shared_format = NULL;
+    gchar *actual_encoder_name = NULL;
 
-    src = gst_element_factory_make("libcamerasrc", "source");
     if (!src) {
-        g_printerr("Failed to create libcamerasrc.\n");
         goto error;
     }
-    g_print("Successfully created libcamerasrc element\n");
-    
-    // Set camera name if specified
-    if (strlen(data->config.camera_name) > 0 && strcmp(data->config.camera_name, "auto-detect") != 0) {
-        g_object_set(src, "camera-name", data->config.camera_name, NULL);
-        g_print("Using camera: %s\n", data->config.camera_name);
-    } else {
-        g_print("Using auto-detected camera\n");
-    }
+    // Parent the (possibly READY) source right away so every error path releases the device
+    gst_bin_add(GST_BIN(data->pipeline), src);
 
     capsfilter = gst_element_factory_make("capsfilter", "capsfilter");
     if (!capsfilter) {
@@ -1683,171 +5879,219 @@ static gboolean build_and_run_pipeline(CustomData *data) {
         goto error;
     }
     
+    encoder = create_encoder(&data->encoders, &data->config, "encoder", &actual_encoder_name);
+    if (!encoder) {
+        g_printerr("No suitable encoder found after trying all fallbacks.\n");
+        goto error;
+    }
+
+    // Frames can only reach the encoder as imported DMABufs when the V4L2 M2M encoder
+    // is in use and the source exports DMABuf-backed buffers
+    gboolean source_exports_dmabuf = strcmp(data->config.source_type, "libcamera") == 0 ||
+                                     strcmp(data->config.source_type, "v4l2") == 0;
+    gboolean use_dmabuf = strcmp(data->config.capture_mode, "system") != 0 &&
+                          !data->dmabuf_import_failed &&
+                          source_exports_dmabuf &&
+                          strcmp(actual_encoder_name, "v4l2h264enc") == 0;
+
+    // Ask the source and encoder which raw formats they share; videoconvert is only
+    // inserted when there is none, or when running without it already failed once
+    if (!data->convert_forced) {
+        shared_format = negotiate_shared_format(src, encoder, &data->config);
+    }
+    if (shared_format) {
+        g_print("Source and encoder share raw format %s, no converter needed\n", shared_format);
+    } else {
+        g_print("No shared raw format between source and encoder%s, inserting videoconvert\n",
+                data->convert_forced ? " (forced after negotiation failure)" : "");
+        use_dmabuf = FALSE;
+    }
+
+    if (!use_dmabuf && strcmp(data->config.capture_mode, "dmabuf") == 0) {
+        g_print("DMABuf capture requested but not possible with source=%s, encoder=%s; using copy path\n",
+                data->config.source_type, actual_encoder_name);
+    }
+    
+    // A rebuild restarts from the configured bitrate; the controller adapts from there
+    data->bitrate.target_kbps = CLAMP(data->config.bitrate_kbps, data->config.min_bitrate_kbps,
+                                      data->config.max_bitrate_kbps);
+    configure_encoder(encoder, actual_encoder_name, use_dmabuf, data->bitrate.target_kbps);
+
+    // Pin the shared format so the source hands frames to the encoder without conversion
     caps = gst_caps_new_simple("video/x-raw",
                                "width", G_TYPE_INT, data->config.width,
                                "height", G_TYPE_INT, data->config.height,
                                "framerate", GST_TYPE_FRACTION, data->config.framerate, 1,
                                NULL);
-    
+    if (shared_format) {
+        gst_caps_set_simple(caps, "format", G_TYPE_STRING, shared_format, NULL);
+    }
+
     gchar *caps_str = gst_caps_to_string(caps);
     g_print("Setting caps: %s\n", caps_str);
     g_free(caps_str);
-    
+
     g_object_set(capsfilter, "caps", caps, NULL);
     gst_caps_unref(caps);
 
-    convert = gst_element_factory_make("videoconvert", "convert");
-    if (!convert) {
-        g_printerr("Failed to create videoconvert element.\n");
-        goto error;
+    convert = NULL;
+    if (!shared_format) {
+        convert = gst_element_factory_make("videoconvert", "convert");
+        if (!convert) {
+            g_printerr("Failed to create videoconvert element.\n");
+            goto error;
+        }
     }
 
-    // Try encoders in order of preference with better error handling
-    const gchar *encoder_fallbacks[] = {
-        data->config.encoder_type,  // First try the requested encoder
-        "v4l2h264enc",             // Hardware encoder (Pi default)
-        "omxh264enc",              // OpenMAX encoder (Pi fallback)
-        "x264enc",                 // Software fallback
-        "nvh264enc",               // NVIDIA if available
-        "vaapih264enc",            // Intel VAAPI if available
-        NULL
-    };
-    
-    encoder = NULL;
-    gchar *actual_encoder_name = NULL;
-    
-    for (int i = 0; encoder_fallbacks[i] && !encoder; i++) {
-        // Skip if we already tried this encoder
-        if (i > 0 && strcmp(encoder_fallbacks[i], data->config.encoder_type) == 0) {
-            continue;
-        }
-        
-        g_print("Trying encoder: %s\n", encoder_fallbacks[i]);
-        encoder = gst_element_factory_make(encoder_fallbacks[i], "encoder");
-        if (encoder) {
-            actual_encoder_name = g_strdup(encoder_fallbacks[i]);
-            g_print("Successfully created encoder: %s\n", actual_encoder_name);
-            break;
-        } else {
-            g_print("Encoder %s not available\n", encoder_fallbacks[i]);
+    tee = NULL;
+    if (data->config.standby_swap) {
+        tee = gst_element_factory_make("tee", "capture_tee");
+        if (!tee) {
+            g_printerr("Failed to create tee element.\n");
+            goto error;
         }
+        // Only one branch is attached between encoder swaps
+        g_object_set(tee, "allow-not-linked", TRUE, NULL);
     }
-    
-    if (!encoder) {
-        g_printerr("No suitable encoder found after trying all fallbacks.\n");
-        goto error;
-    }
-    
-    // Configure encoder settings based on the actual encoder being used
-    if (strcmp(actual_encoder_name, "x264enc") == 0) {
-        g_print("Configuring x264enc encoder\n");
-        g_object_set(encoder, 
-                     "tune", 0x00000004,  // zerolatency
-                     "speed-preset", 1,   // superfast
-                     "bitrate", 2048,     // 2Mbps
-                     "threads", 1,        // Single thread for low latency
-                     "key-int-max", 30,   // GOP size
-                     NULL);
-    } else if (strcmp(actual_encoder_name, "v4l2h264enc") == 0) {
-        g_print("Configuring v4l2h264enc encoder\n");
-        // Use the exact same settings as the old working version
-        GstStructure *ctrls = gst_structure_new("controls", 
-                                               "repeat_sequence_header", G_TYPE_BOOLEAN, TRUE,
-                                               NULL);
-        g_object_set(encoder, "extra-controls", ctrls, NULL);
-        gst_structure_free(ctrls);
-    } else if (strcmp(actual_encoder_name, "omxh264enc") == 0) {
-        g_print("Configuring omxh264enc encoder\n");
-        g_object_set(encoder,
-                     "target-bitrate", 2048000,  // 2Mbps in bits/sec
-                     "control-rate", 2,          // variable bitrate
-                     NULL);
-    } else if (strcmp(actual_encoder_name, "nvh264enc") == 0) {
-        g_print("Configuring nvh264enc encoder\n");
-        g_object_set(encoder,
-                     "bitrate", 2048,
-                     "gop-size", 30,
-                     "preset", 1,  // low-latency-hq
-                     NULL);
-    } else if (strcmp(actual_encoder_name, "vaapih264enc") == 0) {
-        g_print("Configuring vaapih264enc encoder\n");
-        g_object_set(encoder,
-                     "bitrate", 2048,
-                     "keyframe-period", 30,
-                     NULL);
-    }
-    
-    g_free(actual_encoder_name);
 
-    parser = gst_element_factory_make("h264parse", "parser");
-    if (!parser) {
-        g_printerr("Failed to create h264parse element.\n");
-        goto error;
+    gst_bin_add(GST_BIN(data->pipeline), capsfilter);
+    if (convert) {
+        gst_bin_add(GST_BIN(data->pipeline), convert);
     }
-    
-    // Add caps filter after encoder to match the old working pipeline
-    encoder_caps = gst_element_factory_make("capsfilter", "encoder_caps");
-    if (!encoder_caps) {
-        g_printerr("Failed to create encoder caps filter.\n");
-        goto error;
+    if (tee) {
+        gst_bin_add(GST_BIN(data->pipeline), tee);
     }
-    GstCaps *h264_caps = gst_caps_new_simple("video/x-h264",
-                                             "level", G_TYPE_STRING, "4",
-                                             NULL);
-    g_object_set(encoder_caps, "caps", h264_caps, NULL);
-    gst_caps_unref(h264_caps);
 
-    payloader = gst_element_factory_make("rtph264pay", "payloader");
-    if (!payloader) {
-        g_printerr("Failed to create rtph264pay element.\n");
-        goto error;
+    // Latency histograms describe the current pipeline only
+    for (int i = 0; i < LATENCY_STAGE_COUNT; i++) {
+        data->latency[i].element[0] = '\0';
+    }
+    reset_latency_histograms(data);
+    add_latency_probe(data, src, "src", LATENCY_STAGE_SOURCE, NULL);
+    add_latency_probe(data, capsfilter, "src", LATENCY_STAGE_CAPSFILTER, NULL);
+    if (convert) {
+        add_latency_probe(data, convert, "src", LATENCY_STAGE_CONVERT, NULL);
     }
-    g_object_set(payloader, "config-interval", -1, NULL);
 
-    sink = gst_element_factory_make("udpsink", "sink");
-    if (!sink) {
-        g_printerr("Failed to create udpsink element.\n");
+    if (data->config.rtcp && !create_rtcp_session(data)) {
         goto error;
     }
-    
-    g_print("Configuring UDP sink: %s:%d\n", data->config.host, data->config.port);
-    g_object_set(sink, "host", data->config.host, "port", data->config.port, "sync", FALSE, "async", FALSE, NULL);
 
-    // Add probe to monitor data flow for statistics
-    GstPad *sink_pad = gst_element_get_static_pad(sink, "sink");
-    if (sink_pad) {
-        gst_pad_add_probe(sink_pad, GST_PAD_PROBE_TYPE_BUFFER, udpsink_probe_callback, data, NULL);
-        gst_object_unref(sink_pad);
+    atomic_store(&data->rtp_seqnum, g_random_int_range(0, 65536));
+    data->active_branch = create_encode_branch(data, encoder, actual_encoder_name, 0, tee != NULL, TRUE);
+    encoder = NULL;  // owned by the branch now, or already released
+    g_free(actual_encoder_name);
+    actual_encoder_name = NULL;
+    if (!data->active_branch) {
+        goto error;
     }
-
-    gst_bin_add_many(GST_BIN(data->pipeline), src, capsfilter, convert, encoder, encoder_caps, parser, payloader, sink, NULL);
+    data->active_branch->dmabuf_import = use_dmabuf;
     g_print("All elements added to pipeline\n");
 
     g_print("Attempting to link pipeline elements...\n");
-    if (!gst_element_link_many(src, capsfilter, convert, encoder, encoder_caps, parser, payloader, sink, NULL)) {
+    GstElement *branch_head = tee ? tee : data->active_branch->encoder;
+    gboolean linked = convert
+        ? gst_element_link_many(src, capsfilter, convert, branch_head, NULL)
+        : gst_element_link_many(src, capsfilter, branch_head, NULL);
+    if (linked && tee) {
+        data->active_branch->tee_pad = gst_element_request_pad_simple(tee, "src_%u");
+        GstPad *queue_pad = gst_element_get_static_pad(data->active_branch->queue, "sink");
+        linked = data->active_branch->tee_pad &&
+                 gst_pad_link(data->active_branch->tee_pad, queue_pad) == GST_PAD_LINK_OK;
+        gst_object_unref(queue_pad);
+    }
+    if (!linked) {
         g_printerr("Failed to link elements.\n");
         goto error;
     } else {
-        g_print("Successfully linked pipeline elements\n");
+        g_print("Successfully linked pipeline elements (%s, %s%s)\n",
+                use_dmabuf ? "DMABuf import" : "system memory",
+                convert ? "videoconvert" : "no converter",
+                tee ? ", standby swapping enabled" : "");
     }
+    data->dmabuf_path_active = use_dmabuf;
+    data->convert_in_path = (convert != NULL);
 
     g_print("Pipeline built successfully. Starting...\n");
     
     // Reset statistics for new pipeline
+    tx_counters_reset(&data->stats.tx);
+    atomic_store(&data->stats.dmabuf_buffers, 0);
+    atomic_store(&data->stats.system_buffers, 0);
+    atomic_store(&data->stats.encoded_frames, 0);
+    atomic_store(&data->stats.keyframes, 0);
+    atomic_store(&data->stats.encoded_bytes, 0);
+    atomic_store(&data->stats.fec_packets, 0);
+    atomic_store(&data->stats.fec_bytes, 0);
+    atomic_store(&data->stats.rtx_requests, 0);
+    atomic_store(&data->stats.rtx_packets, 0);
+    atomic_store(&data->stats.rtx_bytes, 0);
+    atomic_store(&data->stats.switch_started, 0);
+    atomic_store(&data->stats.tx_syscalls, 0);
+    atomic_store(&data->stats.tx_batches, 0);
+    atomic_store(&data->stats.tx_gso_sends, 0);
+    atomic_store(&data->stats.tx_enobufs, 0);
+    atomic_store(&data->stats.paced_packets, 0);
+    atomic_store(&data->stats.pacing_delay_usec, 0);
+    atomic_store(&data->stats.pacing_delay_max_usec, 0);
+    atomic_store(&data->stats.pacing_overruns, 0);
+    atomic_store(&data->stats.pacing_queued, 0);
+    atomic_store(&data->stats.pacing_queued_max, 0);
+    reset_frame_analytics(&data->analytics);
+    data->stats.logged_packets = 0;
     g_mutex_lock(&data->stats.stats_mutex);
-    data->stats.total_bytes = 0;
-    data->stats.frame_count = 0;
-    data->stats.current_bitrate = 0.0;
+    // The counters restart from zero; the rate ring keeps its history across the rebuild
+    data->stats.rate_last_bytes = 0;
+    data->stats.rate_last_packets = 0;
+    data->stats.rate_last_frames = 0;
     data->stats.start_time = gst_clock_get_time(gst_system_clock_obtain());
+    data->stats.zero_copy_active = use_dmabuf;
+    data->stats.conversion_in_path = (convert != NULL);
+    g_strlcpy(data->stats.negotiated_format, shared_format ? shared_format : "",
+              sizeof(data->stats.negotiated_format));
+    data->stats.target_bitrate_kbps = data->bitrate.target_kbps;
+    read_udp_sndbuf_errors(&data->stats.sndbuf_errors_base);
+    data->stats.kernel_sndbuf_errors = 0;
     g_mutex_unlock(&data->stats.stats_mutex);
+    g_free(shared_format);
+    shared_format = NULL;
     
     GstStateChangeReturn ret = gst_element_set_state(data->pipeline, GST_STATE_PLAYING);
     if (ret == GST_STATE_CHANGE_FAILURE) {
         g_printerr("Failed to set pipeline to PLAYING state.\n");
+        if (use_dmabuf && strcmp(data->config.capture_mode, "auto") == 0) {
+            // Retry once on the copy path; dmabuf_import_failed keeps the retry from recursing
+            g_printerr("DMABuf import path failed to start, falling back to system memory path\n");
+            data->dmabuf_import_failed = TRUE;
+            g_mutex_lock(&data->stats.stats_mutex);
+            data->stats.dmabuf_fallbacks++;
+            g_mutex_unlock(&data->stats.stats_mutex);
+            gst_element_set_state(data->pipeline, GST_STATE_NULL);
+            gst_object_unref(data->pipeline);
+            data->pipeline = NULL;
+            free_encode_branch(data->active_branch);
+            data->active_branch = NULL;
+            clear_rtcp_session(&data->rtcp);
+            g_mutex_unlock(&data->state_mutex);
+            return build_and_run_pipeline(data);
+        }
         goto error;
     }
     
     g_print("Pipeline state change result: %d (PLAYING=%d)\n", ret, GST_STATE_CHANGE_SUCCESS);
+    apply_socket_qos(data);     // the sinks opened their sockets on the way to PAUSED
+
+    gint64 restart_duration = g_get_monotonic_time() - restart_start;
+    g_mutex_lock(&data->stats.stats_mutex);
+    if (old_pipeline) {
+        data->stats.restarts++;
+        data->stats.restart_ms_total += restart_duration / 1000.0;
+    }
+    data->stats.last_restart_ms = restart_duration / 1000.0;
+    data->stats.last_release_wait_ms = release_wait / 1000.0;
+    g_mutex_unlock(&data->stats.stats_mutex);
+    g_print("Pipeline (re)started in %.1f ms (%.1f ms waiting for capture device)\n",
+            restart_duration / 1000.0, release_wait / 1000.0);
     
     // Get the bus after the pipeline is created and started
     data->bus = gst_element_get_bus(data->pipeline);
@@ -1859,10 +6103,19 @@ static gboolean build_and_run_pipeline(CustomData *data) {
 
 error:
     g_printerr("Error during pipeline construction.\n");
+    g_free(shared_format);
+    g_free(actual_encoder_name);
+    if (encoder) {
+        gst_object_unref(gst_object_ref_sink(encoder));
+    }
     if (data->pipeline) {
+        gst_element_set_state(data->pipeline, GST_STATE_NULL);
         gst_object_unref(data->pipeline);
         data->pipeline = NULL;
     }
+    free_encode_branch(data->active_branch);
+    data->active_branch = NULL;
+    clear_rtcp_session(&data->rtcp);
     if (data->bus) {
         gst_object_unref(data->bus);
         data->bus = NULL;
@@ -1871,6 +6124,590 @@ error:
     return FALSE;
 }
 
+// Push the configured width/height/framerate into the running pipeline by updating the
+// capsfilter; the resulting RECONFIGURE makes the source renegotiate and the encoder
+// picks up the new caps. Returns FALSE when the change cannot be attempted in place.
+static gboolean renegotiate_pipeline(CustomData *data) {
+    g_mutex_lock(&data->state_mutex);
+    if (!data->pipeline) {
+        g_mutex_unlock(&data->state_mutex);
+        return FALSE;
+    }
+
+    GstElement *capsfilter = gst_bin_get_by_name(GST_BIN(data->pipeline), "capsfilter");
+    if (!capsfilter) {
+        g_mutex_unlock(&data->state_mutex);
+        return FALSE;
+    }
+
+    // Start from the current filter so a pinned raw format survives the change
+    GstCaps *current = NULL;
+    g_object_get(capsfilter, "caps", &current, NULL);
+    GstCaps *caps = current ? gst_caps_make_writable(current)
+                            : gst_caps_new_empty_simple("video/x-raw");
+    gst_caps_set_simple(caps,
+                        "width", G_TYPE_INT, data->config.width,
+                        "height", G_TYPE_INT, data->config.height,
+                        "framerate", GST_TYPE_FRACTION, data->config.framerate, 1,
+                        NULL);
+
+    gchar *caps_str = gst_caps_to_string(caps);
+    g_print("Renegotiating running pipeline to %s\n", caps_str);
+    g_free(caps_str);
+
+    g_object_set(capsfilter, "caps", caps, NULL);
+    gst_caps_unref(caps);
+    gst_object_unref(capsfilter);
+
+    data->renegotiate_started = g_get_monotonic_time();
+    g_mutex_unlock(&data->state_mutex);
+    return TRUE;
+}
+
+// Called from the main loop while an in-place change is pending: completes it once the
+// capsfilter output carries the new caps, or falls back to a rebuild after the timeout.
+static void check_renegotiation_progress(CustomData *data) {
+    g_mutex_lock(&data->state_mutex);
+    if (data->renegotiate_started == 0 || !data->pipeline) {
+        g_mutex_unlock(&data->state_mutex);
+        return;
+    }
+
+    gboolean done = FALSE;
+    GstElement *capsfilter = gst_bin_get_by_name(GST_BIN(data->pipeline), "capsfilter");
+    if (capsfilter) {
+        GstPad *pad = gst_element_get_static_pad(capsfilter, "src");
+        GstCaps *caps = pad ? gst_pad_get_current_caps(pad) : NULL;
+        if (caps) {
+            GstStructure *st = gst_caps_get_structure(caps, 0);
+            gint width = 0, height = 0, fps_n = 0, fps_d = 1;
+            gst_structure_get_int(st, "width", &width);
+            gst_structure_get_int(st, "height", &height);
+            gst_structure_get_fraction(st, "framerate", &fps_n, &fps_d);
+            done = width == data->config.width && height == data->config.height &&
+                   fps_d > 0 && fps_n == data->config.framerate * fps_d;
+            gst_caps_unref(caps);
+        }
+        if (pad) {
+            gst_object_unref(pad);
+        }
+        gst_object_unref(capsfilter);
+    }
+
+    gint64 elapsed = g_get_monotonic_time() - data->renegotiate_started;
+    if (done) {
+        data->renegotiate_started = 0;
+        g_print("Pipeline renegotiated in place to %dx%d@%dfps in %.1f ms\n",
+                data->config.width, data->config.height, data->config.framerate, elapsed / 1000.0);
+
+        // Give receivers a clean entry point at the new resolution
+        if (data->active_branch) {
+            gst_element_send_event(data->active_branch->encoder,
+                                   gst_video_event_new_upstream_force_key_unit(GST_CLOCK_TIME_NONE, TRUE, 0));
+        }
+
+        g_mutex_lock(&data->stats.stats_mutex);
+        data->stats.renegotiations++;
+        data->stats.last_renegotiation_ms = elapsed / 1000.0;
+        g_mutex_unlock(&data->stats.stats_mutex);
+    } else if (elapsed > RENEGOTIATE_TIMEOUT_USEC) {
+        g_printerr("Source did not renegotiate within %d ms, rebuilding pipeline\n",
+                   RENEGOTIATE_TIMEOUT_USEC / 1000);
+        data->renegotiate_started = 0;
+        data->pipeline_is_restarting = TRUE;
+
+        g_mutex_lock(&data->stats.stats_mutex);
+        data->stats.renegotiation_fallbacks++;
+        g_mutex_unlock(&data->stats.stats_mutex);
+    }
+    g_mutex_unlock(&data->state_mutex);
+}
+
+// Build a branch for the newly configured encoder next to the running one. It stays
+// gated until its first IDR, after which check_standby_branch() retires the old branch.
+// Returns FALSE when no standby branch can be built and the caller should rebuild.
+static gboolean start_standby_branch(CustomData *data) {
+    g_mutex_lock(&data->state_mutex);
+    EncodeBranch *active = data->active_branch;
+    if (!data->pipeline || !active || !active->tee_pad || data->standby_branch) {
+        g_mutex_unlock(&data->state_mutex);
+        return FALSE;
+    }
+
+    GstElement *tee = gst_pad_get_parent_element(active->tee_pad);
+    GstCaps *raw_caps = gst_pad_get_current_caps(active->tee_pad);
+    guint generation = ++data->branch_generation;
+    gchar *name = branch_element_name("encoder", generation);
+    gchar *actual_encoder_name = NULL;
+    GstElement *encoder = create_encoder(&data->encoders, &data->config, name, &actual_encoder_name);
+    g_free(name);
+    EncodeBranch *branch = NULL;
+
+    if (!tee || !encoder) {
+        goto fail;
+    }
+
+    // The capture side keeps running unchanged, so the new encoder has to take its format
+    if (raw_caps) {
+        GstCaps *accepted = query_element_caps(encoder, "sink", NULL);
+        gboolean compatible = accepted && gst_caps_can_intersect(raw_caps, accepted);
+        if (accepted) {
+            gst_caps_unref(accepted);
+        }
+        if (!compatible) {
+            g_print("Encoder %s cannot take the running raw format, rebuilding instead\n",
+                    actual_encoder_name);
+            goto fail;
+        }
+    }
+
+    // DMABufs from the tee can still be imported if the new encoder is the M2M one
+    gboolean use_dmabuf = data->dmabuf_path_active && strcmp(actual_encoder_name, "v4l2h264enc") == 0;
+    configure_encoder(encoder, actual_encoder_name, use_dmabuf, data->bitrate.target_kbps);
+
+    branch = create_encode_branch(data, encoder, actual_encoder_name, generation, TRUE, FALSE);
+    encoder = NULL;
+    if (!branch) {
+        goto fail;
+    }
+    branch->dmabuf_import = use_dmabuf;
+    branch->replaces = active;
+
+    // Continue the running RTP stream (same SSRC and timestamps) so receivers see one stream
+    // across the switch rather than a new source. Sequence numbers are continued by the
+    // gate probe when the switch happens.
+    GstStructure *pay_stats = NULL;
+    g_object_get(active->payloader, "stats", &pay_stats, NULL);
+    if (pay_stats) {
+        guint ssrc = 0, ts_offset = 0;
+        if (gst_structure_get_uint(pay_stats, "ssrc", &ssrc) &&
+            gst_structure_get_uint(pay_stats, "timestamp-offset", &ts_offset)) {
+            g_object_set(branch->payloader,
+                         "ssrc", ssrc,
+                         "timestamp-offset", ts_offset,
+                         NULL);
+        }
+        gst_structure_free(pay_stats);
+    }
+
+    // Bring the branch up downstream-first, then let frames in
+    GstElement *elements[] = {branch->sink, branch->pace_queue, branch->fec_sink, branch->fec,
+                              branch->payloader, branch->parser, branch->encoder_caps,
+                              branch->encoder, branch->queue};
+    for (gsize i = 0; i < G_N_ELEMENTS(elements); i++) {
+        if (elements[i]) {
+            gst_element_sync_state_with_parent(elements[i]);
+        }
+    }
+    apply_socket_qos(data);
+
+    branch->tee_pad = gst_element_request_pad_simple(tee, "src_%u");
+    GstPad *queue_pad = gst_element_get_static_pad(branch->queue, "sink");
+    gboolean linked = branch->tee_pad && gst_pad_link(branch->tee_pad, queue_pad) == GST_PAD_LINK_OK;
+    gst_object_unref(queue_pad);
+    if (!linked) {
+        g_printerr("Failed to attach standby branch to capture tee.\n");
+        remove_encode_branch(data, branch);
+        branch = NULL;
+        goto fail;
+    }
+
+    data->standby_branch = branch;
+    data->standby_started = g_get_monotonic_time();
+    g_print("Standby branch %u warming up with encoder %s\n", generation, actual_encoder_name);
+
+    g_free(actual_encoder_name);
+    gst_object_unref(tee);
+    if (raw_caps) {
+        gst_caps_unref(raw_caps);
+    }
+    g_mutex_unlock(&data->state_mutex);
+    return TRUE;
+
+fail:
+    if (encoder) {
+        gst_object_unref(gst_object_ref_sink(encoder));
+    }
+    g_free(actual_encoder_name);
+    if (tee) {
+        gst_object_unref(tee);
+    }
+    if (raw_caps) {
+        gst_caps_unref(raw_caps);
+    }
+    g_mutex_lock(&data->stats.stats_mutex);
+    data->stats.standby_swap_fallbacks++;
+    g_mutex_unlock(&data->stats.stats_mutex);
+    g_mutex_unlock(&data->state_mutex);
+    return FALSE;
+}
+
+// Called from the main loop while a standby branch exists: promotes it once its first
+// IDR went out, or drops it and falls back to a rebuild after the timeout.
+static void check_standby_branch(CustomData *data) {
+    g_mutex_lock(&data->state_mutex);
+    EncodeBranch *standby = data->standby_branch;
+    if (!standby || !data->pipeline) {
+        g_mutex_unlock(&data->state_mutex);
+        return;
+    }
+
+    gint64 elapsed = g_get_monotonic_time() - data->standby_started;
+    if (g_atomic_int_get(&standby->keyframe_seen)) {
+        EncodeBranch *old = data->active_branch;
+        standby->replaces = NULL;
+        data->active_branch = standby;
+        data->standby_branch = NULL;
+        data->standby_started = 0;
+        data->dmabuf_path_active = standby->dmabuf_import;
+        if (old) {
+            remove_encode_branch(data, old);
+        }
+        name_branch_latency_stages(data, standby);
+        g_print("Switched to encoder %s at its first IDR, %.1f ms after the request\n",
+                standby->encoder_name, elapsed / 1000.0);
+
+        g_mutex_lock(&data->stats.stats_mutex);
+        data->stats.standby_swaps++;
+        data->stats.last_standby_swap_ms = elapsed / 1000.0;
+        data->stats.zero_copy_active = standby->dmabuf_import;
+        g_mutex_unlock(&data->stats.stats_mutex);
+    } else if (elapsed > STANDBY_SWAP_TIMEOUT_USEC) {
+        g_printerr("Standby encoder produced no IDR within %d ms, rebuilding pipeline\n",
+                   STANDBY_SWAP_TIMEOUT_USEC / 1000);
+        data->standby_branch = NULL;
+        data->standby_started = 0;
+        remove_encode_branch(data, standby);
+        data->pipeline_is_restarting = TRUE;
+
+        g_mutex_lock(&data->stats.stats_mutex);
+        data->stats.standby_swap_fallbacks++;
+        g_mutex_unlock(&data->stats.stats_mutex);
+    }
+    g_mutex_unlock(&data->state_mutex);
+}
+
+// Sum the newest `seconds` samples of the ring into per-second rates
+static void window_rates(const StreamStats *stats, guint seconds,
+                         gdouble *kbps_out, gdouble *pps_out, gdouble *fps_out) {
+    guint64 bytes = 0, packets = 0, frames = 0;
+    gdouble span = 0.0;
+    guint n = MIN(seconds, stats->rate_count);
+    for (guint i = 0; i < n; i++) {
+        const RateSample *sample = &stats->rate_ring[(stats->rate_head + RATE_WINDOW_SECONDS - 1 - i) % RATE_WINDOW_SECONDS];
+        bytes += sample->bytes;
+        packets += sample->packets;
+        frames += sample->frames;
+        span += sample->seconds;
+    }
+    *kbps_out = span > 0.0 ? bytes * 8.0 / span / 1000.0 : 0.0;
+    if (pps_out) {
+        *pps_out = span > 0.0 ? packets / span : 0.0;
+    }
+    if (fps_out) {
+        *fps_out = span > 0.0 ? frames / span : 0.0;
+    }
+}
+
+// Called from the main loop: once a second, turn the lock-free counters into a ring
+// sample and refresh the 1 s / 5 s / 60 s windows and the EWMA
+static void sample_stream_rates(CustomData *data) {
+    StreamStats *stats = &data->stats;
+    gint64 now = g_get_monotonic_time();
+
+    g_mutex_lock(&stats->stats_mutex);
+    gint64 elapsed = now - stats->rate_sampled_at;
+    if (elapsed < G_USEC_PER_SEC) {
+        g_mutex_unlock(&stats->stats_mutex);
+        return;
+    }
+
+    guint64 bytes, packets;
+    tx_counters_read(&stats->tx, &bytes, &packets);
+    guint64 frames = atomic_load_explicit(&stats->encoded_frames, memory_order_relaxed);
+
+    RateSample *sample = &stats->rate_ring[stats->rate_head];
+    sample->bytes = bytes - MIN(bytes, stats->rate_last_bytes);
+    sample->packets = packets - MIN(packets, stats->rate_last_packets);
+    sample->frames = frames - MIN(frames, stats->rate_last_frames);
+    sample->seconds = elapsed / (gdouble)G_USEC_PER_SEC;
+    stats->rate_head = (stats->rate_head + 1) % RATE_WINDOW_SECONDS;
+    stats->rate_count = MIN(stats->rate_count + 1, RATE_WINDOW_SECONDS);
+    stats->rate_last_bytes = bytes;
+    stats->rate_last_packets = packets;
+    stats->rate_last_frames = frames;
+    stats->rate_sampled_at = now;
+
+    window_rates(stats, 1, &stats->current_bitrate, &stats->packet_rate_1s, &stats->frame_rate_1s);
+    window_rates(stats, 5, &stats->bitrate_5s, NULL, &stats->frame_rate_5s);
+    window_rates(stats, RATE_WINDOW_SECONDS, &stats->bitrate_60s, NULL, NULL);
+    stats->bitrate_ewma = stats->rate_count == 1
+        ? stats->current_bitrate
+        : BITRATE_EWMA_ALPHA * stats->current_bitrate + (1.0 - BITRATE_EWMA_ALPHA) * stats->bitrate_ewma;
+    g_mutex_unlock(&stats->stats_mutex);
+
+    // Kernel drops come from /proc, read here rather than on every GetStats or scrape
+    guint64 sndbuf_errors = 0;
+    if (read_udp_sndbuf_errors(&sndbuf_errors)) {
+        g_mutex_lock(&stats->stats_mutex);
+        stats->kernel_sndbuf_errors = sndbuf_errors > stats->sndbuf_errors_base
+            ? sndbuf_errors - stats->sndbuf_errors_base : 0;
+        g_mutex_unlock(&stats->stats_mutex);
+    }
+}
+
+// Copy the latest receiver reports out of the RTP session once a second. Runs on the main
+// loop; GetStats only reads the copy.
+static void sample_rtcp_receivers(CustomData *data) {
+    StreamStats *stats = &data->stats;
+    gint64 now = g_get_monotonic_time();
+    if (now - stats->receivers_sampled_at < G_USEC_PER_SEC) {
+        return;
+    }
+    stats->receivers_sampled_at = now;
+
+    g_mutex_lock(&data->state_mutex);
+    GObject *session = data->rtcp.session ? g_object_ref(data->rtcp.session) : NULL;
+    g_mutex_unlock(&data->state_mutex);
+
+    ReceiverReport reports[MAX_RTCP_RECEIVERS];
+    guint count = 0;
+    if (session) {
+        G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+        GValueArray *sources = NULL;
+        g_object_get(session, "sources", &sources, NULL);
+        for (guint i = 0; sources && i < sources->n_values && count < MAX_RTCP_RECEIVERS; i++) {
+            GObject *source = g_value_get_object(g_value_array_get_nth(sources, i));
+            GstStructure *s = NULL;
+            g_object_get(source, "stats", &s, NULL);
+            if (!s) {
+                continue;
+            }
+
+            gboolean internal = FALSE, have_rb = FALSE;
+            gst_structure_get_boolean(s, "internal", &internal);
+            gst_structure_get_boolean(s, "have-rb", &have_rb);
+            if (!internal && have_rb) {
+                ReceiverReport *report = &reports[count++];
+                guint ssrc = 0, fraction = 0, jitter = 0, rtt = 0;
+                gint lost = 0;
+                gst_structure_get_uint(s, "ssrc", &ssrc);
+                gst_structure_get_uint(s, "rb-fractionlost", &fraction);
+                gst_structure_get_int(s, "rb-packetslost", &lost);
+                gst_structure_get_uint(s, "rb-jitter", &jitter);
+                gst_structure_get_uint(s, "rb-round-trip", &rtt);
+                const gchar *from = gst_structure_get_string(s, "rtcp-from");
+                report->ssrc = ssrc;
+                g_strlcpy(report->address, from ? from : "", sizeof(report->address));
+                report->fraction_lost = fraction / 256.0;
+                report->packets_lost = lost;
+                report->jitter_ms = jitter * 1000.0 / RTP_H264_CLOCK_RATE;
+                report->rtt_ms = rtt * 1000.0 / 65536.0;  // NTP short format, 16.16 seconds
+            }
+            gst_structure_free(s);
+        }
+        if (sources) {
+            g_value_array_free(sources);
+        }
+        G_GNUC_END_IGNORE_DEPRECATIONS
+        g_object_unref(session);
+    }
+
+    g_mutex_lock(&stats->stats_mutex);
+    memcpy(stats->receivers, reports, count * sizeof(ReceiverReport));
+    stats->num_receivers = count;
+    g_mutex_unlock(&stats->stats_mutex);
+}
+
+// Move the live encoder to a new bitrate, clamped to the configured bounds. Called with
+// state_mutex held; reason ends up in stats.
+static void apply_target_bitrate(CustomData *data, guint kbps, const gchar *reason) {
+    kbps = CLAMP(kbps, (guint)data->config.min_bitrate_kbps, (guint)data->config.max_bitrate_kbps);
+    guint previous = data->bitrate.target_kbps;
+    data->bitrate.target_kbps = kbps;
+
+    if (data->active_branch) {
+        set_encoder_bitrate(data->active_branch->encoder, data->active_branch->encoder_name, kbps);
+    }
+    if (data->standby_branch) {
+        set_encoder_bitrate(data->standby_branch->encoder, data->standby_branch->encoder_name, kbps);
+    }
+    update_pacing(data);
+
+    g_mutex_lock(&data->stats.stats_mutex);
+    data->stats.target_bitrate_kbps = kbps;
+    if (kbps > previous) {
+        data->stats.bitrate_increases++;
+    } else if (kbps < previous) {
+        data->stats.bitrate_decreases++;
+    }
+    if (kbps != previous) {
+        g_strlcpy(data->stats.bitrate_decision, reason, sizeof(data->stats.bitrate_decision));
+    }
+    g_mutex_unlock(&data->stats.stats_mutex);
+
+    if (kbps != previous) {
+        g_print("Bitrate %u -> %u kbps (%s)\n", previous, kbps, reason);
+    }
+}
+
+// AIMD on receiver feedback, once a second from the main loop. Fresh loss above 10% cuts
+// the bitrate in proportion to the loss, RTT well above its baseline cuts it by 15%, and
+// clean feedback adds 5% (at least 50 kbps) once 3s have passed since the last cut.
+static void run_bitrate_controller(CustomData *data) {
+    BitrateController *ctl = &data->bitrate;
+    gint64 now = g_get_monotonic_time();
+    if (now - ctl->evaluated_at < G_USEC_PER_SEC) {
+        return;
+    }
+    ctl->evaluated_at = now;
+
+    g_mutex_lock(&data->state_mutex);
+    if (!data->config.adaptive_bitrate || !data->active_branch) {
+        g_mutex_unlock(&data->state_mutex);
+        return;
+    }
+
+    // Receiver feedback: an explicit RPC report wins; otherwise the worst RTCP receiver
+    gboolean have_feedback = FALSE, new_loss = FALSE;
+    gdouble loss = 0.0, rtt_ms = 0.0;
+    if (ctl->rpc_received_at > 0 && now - ctl->rpc_received_at < BITRATE_FEEDBACK_MAX_AGE_USEC) {
+        loss = ctl->rpc_loss;
+        rtt_ms = ctl->rpc_rtt_ms;
+        have_feedback = TRUE;
+        new_loss = TRUE;
+        ctl->rpc_received_at = 0;
+    } else {
+        g_mutex_lock(&data->stats.stats_mutex);
+        gint64 lost_total = 0;
+        for (guint i = 0; i < data->stats.num_receivers; i++) {
+            const ReceiverReport *report = &data->stats.receivers[i];
+            loss = MAX(loss, report->fraction_lost);
+            rtt_ms = MAX(rtt_ms, report->rtt_ms);
+            lost_total += MAX(report->packets_lost, 0);
+            have_feedback = TRUE;
+        }
+        g_mutex_unlock(&data->stats.stats_mutex);
+        // A report repeats until the next RTCP interval; only act on loss once
+        new_loss = lost_total > ctl->rtcp_lost_seen;
+        ctl->rtcp_lost_seen = lost_total;
+    }
+    if (!have_feedback) {
+        g_mutex_unlock(&data->state_mutex);
+        return;
+    }
+
+    if (rtt_ms > 0.0 && (ctl->min_rtt_ms <= 0.0 || rtt_ms < ctl->min_rtt_ms)) {
+        ctl->min_rtt_ms = rtt_ms;
+    }
+    gboolean rtt_inflated = rtt_ms > 0.0 && ctl->min_rtt_ms > 0.0 &&
+                            rtt_ms > MAX(2.0 * ctl->min_rtt_ms, ctl->min_rtt_ms + 100.0);
+
+    guint current = ctl->target_kbps;
+    guint target = current;
+    const gchar *reason = NULL;
+    if (new_loss && loss > BITRATE_LOSS_DECREASE) {
+        target = (guint)(current * (1.0 - 0.5 * loss));
+        reason = "loss";
+    } else if (rtt_inflated && now - ctl->decreased_at >= G_USEC_PER_SEC * 2) {
+        target = (guint)(current * 0.85);
+        reason = "rtt";
+    } else if (loss < BITRATE_LOSS_INCREASE && !rtt_inflated &&
+               now - ctl->decreased_at >= BITRATE_INCREASE_HOLDOFF_USEC) {
+        target = current + MAX(current / 20, 50);
+        reason = "probe";
+    }
+
+    g_mutex_lock(&data->stats.stats_mutex);
+    data->stats.feedback_loss = loss;
+    data->stats.feedback_rtt_ms = rtt_ms;
+    g_mutex_unlock(&data->stats.stats_mutex);
+
+    if (reason) {
+        if (target < current) {
+            ctl->decreased_at = now;
+        }
+        apply_target_bitrate(data, target, reason);
+    }
+    g_mutex_unlock(&data->state_mutex);
+}
+
+// Once-a-second progress line, printed from the main loop so a slow journal can never
+// hold up the streaming thread
+static void log_stream_progress(CustomData *data) {
+    static gint64 last_log = 0;
+    gint64 now = g_get_monotonic_time();
+    if (now - last_log < G_USEC_PER_SEC) {
+        return;
+    }
+    last_log = now;
+
+    guint64 total_bytes, packets;
+    tx_counters_read(&data->stats.tx, &total_bytes, &packets);
+    if (packets < data->stats.logged_packets) {
+        data->stats.logged_packets = 0;
+    }
+    if (packets == data->stats.logged_packets) {
+        return;
+    }
+    g_print("Streaming: %llu packets (+%llu), total %llu bytes\n",
+            (unsigned long long)packets,
+            (unsigned long long)(packets - data->stats.logged_packets),
+            (unsigned long long)total_bytes);
+    data->stats.logged_packets = packets;
+}
+
+// Called from the bus loop when the pipeline posts an error. Returns TRUE when the
+// error was absorbed by scheduling a rebuild on a more conservative pipeline layout.
+static gboolean schedule_fallback_rebuild(CustomData *data, GstMessage *msg) {
+    const gchar *src_name = GST_OBJECT_NAME(GST_MESSAGE_SRC(msg));
+    gboolean scheduled = FALSE;
+
+    g_mutex_lock(&data->state_mutex);
+    if (data->standby_branch) {
+        // Whichever branch failed, a fresh pipeline with the new encoder is the safe way out
+        g_printerr("Error in %s during encoder swap, rebuilding pipeline\n", src_name);
+        data->pipeline_is_restarting = TRUE;
+        scheduled = TRUE;
+
+        g_mutex_lock(&data->stats.stats_mutex);
+        data->stats.standby_swap_fallbacks++;
+        g_mutex_unlock(&data->stats.stats_mutex);
+    } else if (data->renegotiate_started > 0) {
+        // The running elements could not take the new caps; start over with a fresh pipeline
+        g_printerr("In-place renegotiation failed in %s, rebuilding pipeline\n", src_name);
+        data->renegotiate_started = 0;
+        data->pipeline_is_restarting = TRUE;
+        scheduled = TRUE;
+
+        g_mutex_lock(&data->stats.stats_mutex);
+        data->stats.renegotiation_fallbacks++;
+        g_mutex_unlock(&data->stats.stats_mutex);
+    } else if (data->dmabuf_path_active && strcmp(data->config.capture_mode, "auto") == 0 &&
+        (g_str_has_prefix(src_name, "source") || g_str_has_prefix(src_name, "capsfilter") ||
+         g_str_has_prefix(src_name, "encoder"))) {
+        g_printerr("DMABuf import failed in %s, falling back to system memory path\n", src_name);
+        data->dmabuf_import_failed = TRUE;
+        data->pipeline_is_restarting = TRUE;
+        scheduled = TRUE;
+
+        g_mutex_lock(&data->stats.stats_mutex);
+        data->stats.dmabuf_fallbacks++;
+        g_mutex_unlock(&data->stats.stats_mutex);
+    } else if (!data->convert_in_path && !data->convert_forced &&
+               (g_str_has_prefix(src_name, "source") || g_str_has_prefix(src_name, "capsfilter") ||
+                g_str_has_prefix(src_name, "encoder"))) {
+        // The caps query promised a shared format but negotiation disagreed at runtime
+        g_printerr("Negotiation without converter failed in %s, rebuilding with videoconvert\n", src_name);
+        data->convert_forced = TRUE;
+        data->pipeline_is_restarting = TRUE;
+        scheduled = TRUE;
+    }
+    g_mutex_unlock(&data->state_mutex);
+
+    return scheduled;
+}
+
 #if HAVE_AVAHI
 // mDNS Entry Group callback - handles service registration state changes
 static void mdns_entry_group_callback(AvahiEntryGroup *group, AvahiEntryGroupState state, void *userdata) {
@@ -2027,6 +6864,7 @@ int main(int argc, char *argv[]) {
 
     memset(&data, 0, sizeof(data));
     data.serial.fd = -1;
+    data.metrics.listen_fd = -1;
     init_config(&data.config);
 
     data.config_file_path = resolve_config_path();
@@ -2044,6 +6882,9 @@ int main(int argc, char *argv[]) {
     }
     g_print("Using configuration file %s\n", data.config_file_path);
 
+    // Probe encoders in the background; the first pipeline build waits for the result
+    encoder_registry_start(&data.encoders);
+
     if (config_file_exists(data.config_file_path)) {
         if (load_config_from_file(&data.config, data.config_file_path)) {
             g_print("Loaded configuration from %s\n", data.config_file_path);
@@ -2061,14 +6902,20 @@ int main(int argc, char *argv[]) {
     }
 
     init_stats(&data.stats);
+    init_camera_table(&data.cameras);
+    data.destinations = g_ptr_array_new_with_free_func(destination_free);
     g_mutex_init(&data.state_mutex);
     g_mutex_init(&data.serial.write_mutex);
     data.should_terminate = FALSE;
 
+    // The test and file sources also run on build hosts, which have no USB gadget
     if (!init_serial_context(&data)) {
-        g_printerr("Failed to initialize USB serial interface.\n");
-        exit_code = -1;
-        goto cleanup;
+        if (strcmp(data.config.source_type, "videotest") != 0 && strcmp(data.config.source_type, "file") != 0) {
+            g_printerr("Failed to initialize USB serial interface.\n");
+            exit_code = -1;
+            goto cleanup;
+        }
+        g_printerr("Warning: USB serial interface unavailable, continuing without serial control.\n");
     }
 
     if (!build_and_run_pipeline(&data)) {
@@ -2090,18 +6937,28 @@ int main(int argc, char *argv[]) {
         .swap_resolution_callback = grpc_swap_resolution_cb,
         .update_host_callback = grpc_update_host_cb,
         .get_devices_callback = grpc_get_devices_cb,
+        .get_latency_callback = grpc_get_latency_cb,
+        .get_frame_analytics_callback = grpc_get_frame_analytics_cb,
+        .report_feedback_callback = grpc_report_feedback_cb,
+        .add_destination_callback = grpc_add_destination_cb,
+        .remove_destination_callback = grpc_remove_destination_cb,
+        .list_destinations_callback = grpc_list_destinations_cb,
         .user_data = &data
     };
 
     // Start gRPC server
-    data.grpc_server = f1sh_grpc_server_start("0.0.0.0:50051", &callbacks);
+    const gchar *grpc_address = g_getenv("F1SH_GRPC_ADDRESS");
+    if (!grpc_address || grpc_address[0] == '\0') {
+        grpc_address = "0.0.0.0:50051";
+    }
+    data.grpc_server = f1sh_grpc_server_start(grpc_address, &callbacks);
     if (data.grpc_server == NULL) {
         g_printerr("Failed to start gRPC server.\n");
         exit_code = -1;
         goto cleanup;
     }
 
-    g_print("gRPC server started on port 50051\n");
+    g_print("gRPC server started on %s\n", grpc_address);
     g_print("Available RPC methods:\n");
     g_print("  Health - Health check\n");
     g_print("  GetStats - Stream statistics\n");
@@ -2110,6 +6967,20 @@ int main(int argc, char *argv[]) {
     g_print("  SwapResolution - Swap width/height\n");
     g_print("  UpdateHost - Update UDP destination\n");
     g_print("  GetAvailableDevices - List cameras and encoders\n");
+    g_print("  WatchCameras - Stream camera hotplug events\n");
+    g_print("  WatchStats - Stream stats at a requested interval\n");
+    g_print("  GetFrameAnalytics - Frame sizes per picture type and GOP length\n");
+    g_print("  ReportReceiverFeedback - Loss/RTT input for adaptive bitrate\n");
+    g_print("  GetLatencyBreakdown - Per-stage buffer latency percentiles\n");
+    g_print("  AddDestination/RemoveDestination/ListDestinations - Extra UDP receivers\n");
+
+    if (!start_metrics_server(&data)) {
+        g_printerr("Warning: metrics endpoint unavailable.\n");
+    }
+
+    if (!start_camera_monitor(&data)) {
+        g_printerr("Warning: camera hotplug monitoring unavailable.\n");
+    }
 
 #if HAVE_AVAHI
     // Initialize mDNS service advertisement
@@ -2140,6 +7011,10 @@ int main(int argc, char *argv[]) {
         // Check if pipeline restart is needed
         if (data.pipeline_is_restarting) {
             data.pipeline_is_restarting = FALSE;
+            // A rebuild applies the latest size too, so any in-place change is moot
+            data.pipeline_needs_renegotiate = FALSE;
+            data.renegotiate_started = 0;
+            data.pipeline_needs_branch_swap = FALSE;
             g_mutex_unlock(&data.state_mutex);
             
             g_print("Rebuilding pipeline with new configuration...\n");
@@ -2151,6 +7026,42 @@ int main(int argc, char *argv[]) {
             }
             continue;
         }
+
+        // Resolution/framerate changes are first tried on the running pipeline
+        if (data.pipeline_needs_renegotiate) {
+            data.pipeline_needs_renegotiate = FALSE;
+            g_mutex_unlock(&data.state_mutex);
+
+            if (!renegotiate_pipeline(&data)) {
+                g_mutex_lock(&data.state_mutex);
+                data.pipeline_is_restarting = TRUE;
+                g_mutex_unlock(&data.state_mutex);
+            }
+            continue;
+        }
+
+        // Encoder changes are made on a standby branch when the pipeline has a capture tee
+        if (data.pipeline_needs_branch_swap) {
+            data.pipeline_needs_branch_swap = FALSE;
+            g_mutex_unlock(&data.state_mutex);
+
+            if (!start_standby_branch(&data)) {
+                g_mutex_lock(&data.state_mutex);
+                data.pipeline_is_restarting = TRUE;
+                g_mutex_unlock(&data.state_mutex);
+            }
+            continue;
+        }
+        g_mutex_unlock(&data.state_mutex);
+
+        check_renegotiation_progress(&data);
+        check_standby_branch(&data);
+        sample_stream_rates(&data);
+        sample_rtcp_receivers(&data);
+        run_bitrate_controller(&data);
+        log_stream_progress(&data);
+
+        g_mutex_lock(&data.state_mutex);
         
         // Get bus reference safely
         bus = data.bus;
@@ -2173,6 +7084,13 @@ int main(int argc, char *argv[]) {
                         g_printerr("ERROR from element %s: %s\n", GST_OBJECT_NAME(msg->src), err->message);
                         g_printerr("Debugging info: %s\n", debug_info ? debug_info : "none");
                         
+                        // Fallbacks are one-shot (sticky flags), so this cannot loop forever
+                        if (schedule_fallback_rebuild(&data, msg)) {
+                            g_clear_error(&err);
+                            g_free(debug_info);
+                            break;
+                        }
+
                         // Log encoder errors but don't auto-fallback to avoid infinite loops
                         if (strstr(GST_OBJECT_NAME(msg->src), "encoder")) {
                             g_printerr("Encoder error detected. Consider using a different encoder via serial config update.\n");
@@ -2196,10 +7114,23 @@ int main(int argc, char *argv[]) {
                         g_clear_error(&err);
                         g_free(debug_info);
                         break;
-                    case GST_MESSAGE_EOS:
+                    case GST_MESSAGE_EOS: {
+                        // File sources loop so benchmark runs can go on indefinitely
+                        gboolean looped = FALSE;
+                        g_mutex_lock(&data.state_mutex);
+                        if (data.pipeline && g_strcmp0(data.config.source_type, "file") == 0) {
+                            looped = gst_element_seek_simple(data.pipeline, GST_FORMAT_TIME,
+                                                             GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT, 0);
+                        }
+                        g_mutex_unlock(&data.state_mutex);
+                        if (looped) {
+                            g_print("End-Of-Stream reached on file source, looping.\n");
+                            break;
+                        }
                         g_print("End-Of-Stream reached.\n");
                         data.should_terminate = TRUE;
                         break;
+                    }
                     case GST_MESSAGE_STATE_CHANGED:
                         g_mutex_lock(&data.state_mutex);
                         if (data.pipeline && GST_MESSAGE_SRC(msg) == GST_OBJECT(data.pipeline)) {
@@ -2223,11 +7154,35 @@ int main(int argc, char *argv[]) {
 
     } while (!data.should_terminate);
 
+    // One line for bounded runs to check; a run that encoded nothing has failed
+    grpc_stats_t final_stats;
+    memset(&final_stats, 0, sizeof(final_stats));
+    grpc_get_stats_cb(&data, &final_stats);
+    g_mutex_lock(&data.state_mutex);
+    gchar *final_tx_mode = g_strdup(data.config.tx_mode ? data.config.tx_mode : DEFAULT_TX_MODE);
+    g_mutex_unlock(&data.state_mutex);
+    g_print("Final stats: frames=%" G_GUINT64_FORMAT " keyframes=%" G_GUINT64_FORMAT
+            " rtp_packets=%" G_GUINT64_FORMAT " bytes=%" G_GUINT64_FORMAT
+            " tx_mode=%s tx_syscalls=%" G_GUINT64_FORMAT " tx_syscalls_per_frame=%.2f"
+            " rtp_packets_per_frame=%.2f\n",
+            (guint64)final_stats.frame_count, (guint64)final_stats.keyframes,
+            (guint64)final_stats.rtp_packets, (guint64)final_stats.total_bytes,
+            final_tx_mode, (guint64)final_stats.tx_syscalls,
+            final_stats.tx_syscalls_per_frame, final_stats.rtp_packets_per_frame);
+    g_free(final_tx_mode);
+    if (g_getenv("F1SH_NUM_BUFFERS") && final_stats.frame_count == 0) {
+        g_printerr("Bounded run encoded no frames\n");
+        exit_code = 1;
+    }
+
 cleanup:
+    shutdown_camera_monitor(&data);
+
 #if HAVE_AVAHI
     shutdown_mdns_service(&data);
 #endif
 
+    stop_metrics_server(&data);
     if (data.grpc_server) {
         f1sh_grpc_server_stop(data.grpc_server);
         data.grpc_server = NULL;
@@ -2239,6 +7194,11 @@ cleanup:
         gst_object_unref(data.pipeline);
         data.pipeline = NULL;
     }
+    free_encode_branch(data.active_branch);
+    free_encode_branch(data.standby_branch);
+    data.active_branch = NULL;
+    data.standby_branch = NULL;
+    clear_rtcp_session(&data.rtcp);
     if (data.bus) {
         gst_object_unref(data.bus);
         data.bus = NULL;
@@ -2246,8 +7206,10 @@ cleanup:
     g_mutex_unlock(&data.state_mutex);
 
     shutdown_serial_context(&data);
+    encoder_registry_clear(&data.encoders);
     free_config_members(&data.config);
     free_stats(&data.stats);
+    g_ptr_array_free(data.destinations, TRUE);
     g_mutex_clear(&data.state_mutex);
     g_free(data.config_file_path);
 
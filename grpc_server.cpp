@@ -1,6 +1,16 @@
 // gRPC service implementation with C wrapper for F1sh Camera TX
 #include <grpcpp/grpcpp.h>
 #include <grpcpp/health_check_service_interface.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 // Server reflection support (optional - for grpcurl compatibility)
 #ifdef HAVE_GRPC_REFLECTION
@@ -17,6 +27,7 @@ extern "C" {
 using grpc::Server;
 using grpc::ServerBuilder;
 using grpc::ServerContext;
+using grpc::ServerWriter;
 using grpc::Status;
 
 using f1sh_camera::F1shCameraService;
@@ -34,14 +45,431 @@ using f1sh_camera::UpdateHostRequest;
 using f1sh_camera::UpdateHostResponse;
 using f1sh_camera::GetAvailableDevicesRequest;
 using f1sh_camera::GetAvailableDevicesResponse;
+using f1sh_camera::WatchCamerasRequest;
+using f1sh_camera::CameraEvent;
+using f1sh_camera::GetLatencyBreakdownRequest;
+using f1sh_camera::WatchStatsRequest;
+using f1sh_camera::StatsSample;
+using f1sh_camera::GetFrameAnalyticsRequest;
+using f1sh_camera::ReportReceiverFeedbackRequest;
+using f1sh_camera::ReportReceiverFeedbackResponse;
+using f1sh_camera::GetFrameAnalyticsResponse;
+using f1sh_camera::GetLatencyBreakdownResponse;
+using f1sh_camera::AddDestinationRequest;
+using f1sh_camera::RemoveDestinationRequest;
+using f1sh_camera::DestinationResponse;
+using f1sh_camera::ListDestinationsRequest;
+using f1sh_camera::ListDestinationsResponse;
+
+// Copy a C camera structure into its protobuf counterpart
+static void FillCameraMessage(const grpc_camera_info_t& camera, f1sh_camera::CameraInfo* info) {
+    if (camera.name) info->set_name(camera.name);
+    if (camera.path) info->set_path(camera.path);
+    if (camera.caps) info->set_caps(camera.caps);
+}
+
+// Fans camera hotplug events out to WatchCameras streams. Each subscriber has its own
+// queue so a slow client never blocks the device monitor thread.
+class CameraEventHub {
+public:
+    struct Subscriber {
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::deque<CameraEvent> queue;
+        bool closed = false;
+    };
+
+    std::shared_ptr<Subscriber> Subscribe() {
+        auto sub = std::make_shared<Subscriber>();
+        std::lock_guard<std::mutex> lock(mutex_);
+        subscribers_.push_back(sub);
+        return sub;
+    }
+
+    void Unsubscribe(const std::shared_ptr<Subscriber>& sub) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto it = subscribers_.begin(); it != subscribers_.end(); ++it) {
+            if (*it == sub) {
+                subscribers_.erase(it);
+                break;
+            }
+        }
+    }
+
+    void Publish(const CameraEvent& event) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& sub : subscribers_) {
+            std::lock_guard<std::mutex> sub_lock(sub->mutex);
+            sub->queue.push_back(event);
+            sub->cv.notify_one();
+        }
+    }
+
+    // Wake every stream so server shutdown does not wait on idle watchers
+    void CloseAll() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& sub : subscribers_) {
+            std::lock_guard<std::mutex> sub_lock(sub->mutex);
+            sub->closed = true;
+            sub->cv.notify_one();
+        }
+    }
+
+private:
+    std::mutex mutex_;
+    std::vector<std::shared_ptr<Subscriber>> subscribers_;
+};
+
+// Copy a C config structure into its protobuf counterpart
+static void FillConfigMessage(const grpc_config_t& config, f1sh_camera::Config* cfg) {
+    if (config.host) cfg->set_host(config.host);
+    cfg->set_port(config.port);
+    if (config.camera_name) cfg->set_camera_name(config.camera_name);
+    if (config.encoder_type) cfg->set_encoder_type(config.encoder_type);
+    cfg->set_width(config.width);
+    cfg->set_height(config.height);
+    cfg->set_framerate(config.framerate);
+    if (config.source_type) cfg->set_source_type(config.source_type);
+    if (config.source_device) cfg->set_source_device(config.source_device);
+    if (config.test_pattern) cfg->set_test_pattern(config.test_pattern);
+    if (config.test_motion) cfg->set_test_motion(config.test_motion);
+    if (config.capture_mode) cfg->set_capture_mode(config.capture_mode);
+    if (config.pixel_format) cfg->set_pixel_format(config.pixel_format);
+    cfg->set_live_renegotiate(config.live_renegotiate != 0);
+    cfg->set_standby_swap(config.standby_swap != 0);
+    cfg->set_rtcp(config.rtcp != 0);
+    cfg->set_rtcp_port(config.rtcp_port);
+    cfg->set_bitrate_kbps(config.bitrate_kbps);
+    cfg->set_min_bitrate_kbps(config.min_bitrate_kbps);
+    cfg->set_max_bitrate_kbps(config.max_bitrate_kbps);
+    cfg->set_adaptive_bitrate(config.adaptive_bitrate != 0);
+    if (config.fec) cfg->set_fec(config.fec);
+    cfg->set_fec_percentage(config.fec_percentage);
+    cfg->set_rtx(config.rtx != 0);
+    cfg->set_rtx_history_ms(config.rtx_history_ms);
+    if (config.tx_mode) cfg->set_tx_mode(config.tx_mode);
+    cfg->set_pacing_factor(config.pacing_factor);
+    cfg->set_pacing_max_delay_ms(config.pacing_max_delay_ms);
+    cfg->set_rtp_mtu(config.rtp_mtu);
+    if (config.rtp_aggregate) cfg->set_rtp_aggregate(config.rtp_aggregate);
+    cfg->set_dscp(config.dscp);
+    cfg->set_socket_priority(config.socket_priority);
+    cfg->set_send_buffer_kb(config.send_buffer_kb);
+}
+
+// Free strings allocated by the C callbacks inside a config structure
+static void FreeConfigStrings(grpc_config_t* config) {
+    free(config->host);
+    free(config->camera_name);
+    free(config->encoder_type);
+    free(config->source_type);
+    free(config->source_device);
+    free(config->test_pattern);
+    free(config->test_motion);
+    free(config->capture_mode);
+    free(config->pixel_format);
+    free(config->fec);
+    free(config->tx_mode);
+    free(config->rtp_aggregate);
+}
+
+// Copy a C stats snapshot into its protobuf counterpart
+static void FillStatsMessage(const grpc_stats_t& snapshot, f1sh_camera::StreamStats* stats) {
+    stats->set_total_bytes(snapshot.total_bytes);
+    stats->set_frame_count(snapshot.frame_count);
+    stats->set_current_bitrate(snapshot.bitrate);
+    stats->set_capture_path(snapshot.zero_copy_active ? "dmabuf" : "system");
+    stats->set_dmabuf_buffers(snapshot.dmabuf_buffers);
+    stats->set_system_memory_buffers(snapshot.system_buffers);
+    stats->set_dmabuf_fallbacks(snapshot.dmabuf_fallbacks);
+    stats->set_conversion_in_path(snapshot.conversion_in_path != 0);
+    stats->set_negotiated_format(snapshot.negotiated_format);
+    stats->set_renegotiations(snapshot.renegotiations);
+    stats->set_renegotiation_fallbacks(snapshot.renegotiation_fallbacks);
+    stats->set_last_renegotiation_ms(snapshot.last_renegotiation_ms);
+    stats->set_restarts(snapshot.restarts);
+    stats->set_last_restart_ms(snapshot.last_restart_ms);
+    stats->set_last_release_wait_ms(snapshot.last_release_wait_ms);
+    stats->set_standby_swaps(snapshot.standby_swaps);
+    stats->set_standby_swap_fallbacks(snapshot.standby_swap_fallbacks);
+    stats->set_last_standby_swap_ms(snapshot.last_standby_swap_ms);
+    stats->set_rtp_packets(snapshot.rtp_packets);
+    stats->set_keyframes(snapshot.keyframes);
+    stats->set_delta_frames(snapshot.delta_frames);
+    stats->set_encoded_bytes(snapshot.encoded_bytes);
+    stats->set_bitrate_5s(snapshot.bitrate_5s);
+    stats->set_bitrate_60s(snapshot.bitrate_60s);
+    stats->set_bitrate_ewma(snapshot.bitrate_ewma);
+    stats->set_packet_rate(snapshot.packet_rate);
+    stats->set_frame_rate(snapshot.frame_rate);
+    stats->set_frame_rate_5s(snapshot.frame_rate_5s);
+    stats->set_avg_idr_bytes(snapshot.avg_idr_bytes);
+    stats->set_max_idr_bytes(snapshot.max_idr_bytes);
+    stats->set_avg_p_bytes(snapshot.avg_p_bytes);
+    stats->set_last_gop_length(snapshot.last_gop_length);
+    stats->set_sps_count(snapshot.sps_count);
+    stats->set_pps_count(snapshot.pps_count);
+    stats->set_target_bitrate_kbps(snapshot.target_bitrate_kbps);
+    stats->set_bitrate_increases(snapshot.bitrate_increases);
+    stats->set_bitrate_decreases(snapshot.bitrate_decreases);
+    stats->set_bitrate_decision(snapshot.bitrate_decision);
+    stats->set_feedback_loss(snapshot.feedback_loss);
+    stats->set_feedback_rtt_ms(snapshot.feedback_rtt_ms);
+    stats->set_fec_packets(snapshot.fec_packets);
+    stats->set_fec_bytes(snapshot.fec_bytes);
+    stats->set_rtx_requests(snapshot.rtx_requests);
+    stats->set_rtx_packets(snapshot.rtx_packets);
+    stats->set_rtx_bytes(snapshot.rtx_bytes);
+    stats->set_tx_syscalls(snapshot.tx_syscalls);
+    stats->set_tx_batches(snapshot.tx_batches);
+    stats->set_tx_gso_sends(snapshot.tx_gso_sends);
+    stats->set_tx_syscalls_per_frame(snapshot.tx_syscalls_per_frame);
+    stats->set_paced_packets(snapshot.paced_packets);
+    stats->set_pacing_delay_avg_ms(snapshot.pacing_delay_avg_ms);
+    stats->set_pacing_delay_max_ms(snapshot.pacing_delay_max_ms);
+    stats->set_pacing_overruns(snapshot.pacing_overruns);
+    stats->set_pacing_queue_depth(snapshot.pacing_queue_depth);
+    stats->set_pacing_queue_max(snapshot.pacing_queue_max);
+    stats->set_rtp_mtu(snapshot.rtp_mtu);
+    stats->set_rtp_packets_per_frame(snapshot.rtp_packets_per_frame);
+    stats->set_rtp_overhead_ratio(snapshot.rtp_overhead_ratio);
+    stats->set_kernel_sndbuf_errors(snapshot.kernel_sndbuf_errors);
+    stats->set_tx_enobufs(snapshot.tx_enobufs);
+    stats->set_destination_switches(snapshot.destination_switches);
+    stats->set_last_destination_switch_ms(snapshot.last_destination_switch_ms);
+    for (int i = 0; i < snapshot.num_receivers && i < GRPC_MAX_RECEIVERS; i++) {
+        const grpc_receiver_stats_t& src = snapshot.receivers[i];
+        auto* receiver = stats->add_receivers();
+        receiver->set_ssrc(src.ssrc);
+        receiver->set_address(src.address);
+        receiver->set_fraction_lost(src.fraction_lost);
+        receiver->set_packets_lost(src.packets_lost);
+        receiver->set_jitter_ms(src.jitter_ms);
+        receiver->set_rtt_ms(src.rtt_ms);
+    }
+}
+
+// Unary RPCs whose handling time is tracked for the metrics endpoint
+enum RpcMethod {
+    RPC_HEALTH,
+    RPC_GET_STATS,
+    RPC_GET_CONFIG,
+    RPC_UPDATE_CONFIG,
+    RPC_SWAP_RESOLUTION,
+    RPC_UPDATE_HOST,
+    RPC_GET_AVAILABLE_DEVICES,
+    RPC_GET_LATENCY_BREAKDOWN,
+    RPC_GET_FRAME_ANALYTICS,
+    RPC_REPORT_RECEIVER_FEEDBACK,
+    RPC_ADD_DESTINATION,
+    RPC_REMOVE_DESTINATION,
+    RPC_LIST_DESTINATIONS,
+    RPC_METHOD_COUNT
+};
+
+static const char* const kRpcMethodNames[RPC_METHOD_COUNT] = {
+    "Health", "GetStats", "GetConfig", "UpdateConfig", "SwapResolution",
+    "UpdateHost", "GetAvailableDevices", "GetLatencyBreakdown", "GetFrameAnalytics",
+    "ReportReceiverFeedback", "AddDestination", "RemoveDestination", "ListDestinations"
+};
+
+static const double kRpcLatencyBoundsMs[] = GRPC_RPC_LATENCY_BOUNDS_MS;
+static_assert(sizeof(kRpcLatencyBoundsMs) / sizeof(kRpcLatencyBoundsMs[0]) + 1 == GRPC_RPC_LATENCY_BUCKETS,
+              "one bucket per bound plus overflow");
+
+// Lock-free latency histogram per method; read by the metrics endpoint
+class RpcLatency {
+public:
+    void Record(RpcMethod method, double ms) {
+        Method& m = methods_[method];
+        size_t bucket = 0;
+        while (bucket < GRPC_RPC_LATENCY_BUCKETS - 1 && ms > kRpcLatencyBoundsMs[bucket]) {
+            bucket++;
+        }
+        m.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        m.count.fetch_add(1, std::memory_order_relaxed);
+        m.sum_us.fetch_add(static_cast<uint64_t>(ms * 1000.0), std::memory_order_relaxed);
+    }
+
+    int Snapshot(grpc_rpc_latency_t* out, int max) const {
+        int n = 0;
+        for (int i = 0; i < RPC_METHOD_COUNT && n < max; i++, n++) {
+            const Method& m = methods_[i];
+            out[n].method = kRpcMethodNames[i];
+            out[n].count = m.count.load(std::memory_order_relaxed);
+            out[n].sum_ms = m.sum_us.load(std::memory_order_relaxed) / 1000.0;
+            for (int b = 0; b < GRPC_RPC_LATENCY_BUCKETS; b++) {
+                out[n].buckets[b] = m.buckets[b].load(std::memory_order_relaxed);
+            }
+        }
+        return n;
+    }
+
+private:
+    struct Method {
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> sum_us{0};
+        std::atomic<uint64_t> buckets[GRPC_RPC_LATENCY_BUCKETS] = {};
+    };
+    Method methods_[RPC_METHOD_COUNT];
+};
+
+// Records the enclosing handler's duration when it goes out of scope
+class RpcTimer {
+public:
+    RpcTimer(RpcLatency& latency, RpcMethod method)
+        : latency_(latency), method_(method), start_(std::chrono::steady_clock::now()) {}
+    ~RpcTimer() {
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start_;
+        latency_.Record(method_, elapsed.count());
+    }
+
+private:
+    RpcLatency& latency_;
+    RpcMethod method_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+// WatchStats subscribers due within this much of a sampler tick share its snapshot
+static const std::chrono::milliseconds kStatsCoalesce(10);
+
+// Samples stats once per tick and hands the snapshot to every WatchStats stream that is
+// due. Each stream keeps only the newest undelivered snapshot, so a slow client skips
+// samples instead of holding up the sampler or other clients.
+class StatsBroadcaster {
+public:
+    struct Subscriber {
+        std::chrono::milliseconds interval;
+        std::chrono::steady_clock::time_point next_due;
+        std::shared_ptr<const f1sh_camera::StreamStats> pending;
+        uint64_t sequence = 0;       // sampler tick of the pending snapshot
+        uint64_t skipped = 0;        // snapshots replaced before the stream wrote them
+        std::condition_variable cv;
+    };
+
+    explicit StatsBroadcaster(const grpc_callbacks& callbacks) : callbacks_(callbacks) {}
+
+    ~StatsBroadcaster() {
+        Close();
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+    }
+
+    std::shared_ptr<Subscriber> Subscribe(std::chrono::milliseconds interval) {
+        auto sub = std::make_shared<Subscriber>();
+        sub->interval = interval;
+        sub->next_due = std::chrono::steady_clock::now();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        subscribers_.push_back(sub);
+        if (!thread_.joinable() && !closed_) {
+            thread_ = std::thread(&StatsBroadcaster::Run, this);
+        }
+        cv_.notify_one();
+        return sub;
+    }
+
+    void Unsubscribe(const std::shared_ptr<Subscriber>& sub) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto it = subscribers_.begin(); it != subscribers_.end(); ++it) {
+            if (*it == sub) {
+                subscribers_.erase(it);
+                break;
+            }
+        }
+    }
+
+    // Take the subscriber's pending snapshot, waiting up to timeout for one.
+    // Returns false once the broadcaster is closed.
+    bool Next(const std::shared_ptr<Subscriber>& sub, std::chrono::milliseconds timeout,
+              std::shared_ptr<const f1sh_camera::StreamStats>* stats, uint64_t* sequence,
+              uint64_t* skipped) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        sub->cv.wait_for(lock, timeout, [this, &sub] { return closed_ || sub->pending; });
+        if (closed_) {
+            return false;
+        }
+        stats->swap(sub->pending);
+        sub->pending.reset();
+        *sequence = sub->sequence;
+        *skipped = sub->skipped;
+        return true;
+    }
+
+    void Close() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        cv_.notify_one();
+        for (auto& sub : subscribers_) {
+            sub->cv.notify_one();
+        }
+    }
+
+private:
+    void Run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!closed_) {
+            if (subscribers_.empty()) {
+                cv_.wait(lock, [this] { return closed_ || !subscribers_.empty(); });
+                continue;
+            }
+
+            auto due = subscribers_.front()->next_due;
+            for (const auto& sub : subscribers_) {
+                due = std::min(due, sub->next_due);
+            }
+            if (std::chrono::steady_clock::now() + kStatsCoalesce < due) {
+                // A new subscriber notifies cv_ so its first sample is not delayed
+                cv_.wait_until(lock, due);
+                continue;
+            }
+
+            lock.unlock();
+            grpc_stats_t snapshot = {0};
+            callbacks_.get_stats_callback(callbacks_.user_data, &snapshot);
+            auto stats = std::make_shared<f1sh_camera::StreamStats>();
+            FillStatsMessage(snapshot, stats.get());
+            lock.lock();
+
+            sequence_++;
+            auto now = std::chrono::steady_clock::now();
+            for (auto& sub : subscribers_) {
+                if (sub->next_due > now + kStatsCoalesce) {
+                    continue;
+                }
+                if (sub->pending) {
+                    sub->skipped++;
+                }
+                sub->pending = stats;
+                sub->sequence = sequence_;
+                sub->next_due += sub->interval;
+                if (sub->next_due <= now) {
+                    sub->next_due = now + sub->interval;
+                }
+                sub->cv.notify_one();
+            }
+        }
+    }
+
+    grpc_callbacks callbacks_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::vector<std::shared_ptr<Subscriber>> subscribers_;
+    std::thread thread_;
+    uint64_t sequence_ = 0;
+    bool closed_ = false;
+};
 
 // gRPC service implementation
 class F1shCameraServiceImpl final : public F1shCameraService::Service {
 public:
-    F1shCameraServiceImpl(const grpc_callbacks* callbacks) : callbacks_(*callbacks) {}
+    F1shCameraServiceImpl(const grpc_callbacks* callbacks)
+        : callbacks_(*callbacks), stats_broadcaster_(*callbacks) {}
 
     Status Health(ServerContext* context, const HealthRequest* request,
                   HealthResponse* response) override {
+        RpcTimer timer(rpc_latency_, RPC_HEALTH);
         char* status = nullptr;
         callbacks_.health_callback(callbacks_.user_data, &status);
         if (status) {
@@ -55,43 +483,32 @@ public:
 
     Status GetStats(ServerContext* context, const GetStatsRequest* request,
                     GetStatsResponse* response) override {
-        uint64_t total_bytes = 0, frame_count = 0;
-        double bitrate = 0.0;
-
-        callbacks_.get_stats_callback(callbacks_.user_data, &total_bytes, &frame_count, &bitrate);
+        RpcTimer timer(rpc_latency_, RPC_GET_STATS);
+        grpc_stats_t snapshot = {0};
+        callbacks_.get_stats_callback(callbacks_.user_data, &snapshot);
 
-        auto* stats = response->mutable_stats();
-        stats->set_total_bytes(total_bytes);
-        stats->set_frame_count(frame_count);
-        stats->set_current_bitrate(bitrate);
+        FillStatsMessage(snapshot, response->mutable_stats());
 
         return Status::OK;
     }
 
     Status GetConfig(ServerContext* context, const GetConfigRequest* request,
                      GetConfigResponse* response) override {
+        RpcTimer timer(rpc_latency_, RPC_GET_CONFIG);
         grpc_config_t config = {0};
         callbacks_.get_config_callback(callbacks_.user_data, &config);
 
-        auto* cfg = response->mutable_config();
-        if (config.host) cfg->set_host(config.host);
-        cfg->set_port(config.port);
-        if (config.camera_name) cfg->set_camera_name(config.camera_name);
-        if (config.encoder_type) cfg->set_encoder_type(config.encoder_type);
-        cfg->set_width(config.width);
-        cfg->set_height(config.height);
-        cfg->set_framerate(config.framerate);
+        FillConfigMessage(config, response->mutable_config());
 
         // Free allocated strings
-        free(config.host);
-        free(config.camera_name);
-        free(config.encoder_type);
+        FreeConfigStrings(&config);
 
         return Status::OK;
     }
 
     Status UpdateConfig(ServerContext* context, const UpdateConfigRequest* request,
                         UpdateConfigResponse* response) override {
+        RpcTimer timer(rpc_latency_, RPC_UPDATE_CONFIG);
         grpc_config_update_t update = {0};
 
         if (request->has_host()) {
@@ -122,6 +539,110 @@ public:
             update.framerate = request->framerate();
             update.has_framerate = 1;
         }
+        if (request->has_source_type()) {
+            update.source_type = strdup(request->source_type().c_str());
+            update.has_source_type = 1;
+        }
+        if (request->has_source_device()) {
+            update.source_device = strdup(request->source_device().c_str());
+            update.has_source_device = 1;
+        }
+        if (request->has_test_pattern()) {
+            update.test_pattern = strdup(request->test_pattern().c_str());
+            update.has_test_pattern = 1;
+        }
+        if (request->has_test_motion()) {
+            update.test_motion = strdup(request->test_motion().c_str());
+            update.has_test_motion = 1;
+        }
+        if (request->has_capture_mode()) {
+            update.capture_mode = strdup(request->capture_mode().c_str());
+            update.has_capture_mode = 1;
+        }
+        if (request->has_pixel_format()) {
+            update.pixel_format = strdup(request->pixel_format().c_str());
+            update.has_pixel_format = 1;
+        }
+        if (request->has_live_renegotiate()) {
+            update.live_renegotiate = request->live_renegotiate() ? 1 : 0;
+            update.has_live_renegotiate = 1;
+        }
+        if (request->has_standby_swap()) {
+            update.standby_swap = request->standby_swap() ? 1 : 0;
+            update.has_standby_swap = 1;
+        }
+        if (request->has_rtcp()) {
+            update.rtcp = request->rtcp() ? 1 : 0;
+            update.has_rtcp = 1;
+        }
+        if (request->has_rtcp_port()) {
+            update.rtcp_port = request->rtcp_port();
+            update.has_rtcp_port = 1;
+        }
+        if (request->has_bitrate_kbps()) {
+            update.bitrate_kbps = request->bitrate_kbps();
+            update.has_bitrate_kbps = 1;
+        }
+        if (request->has_min_bitrate_kbps()) {
+            update.min_bitrate_kbps = request->min_bitrate_kbps();
+            update.has_min_bitrate_kbps = 1;
+        }
+        if (request->has_max_bitrate_kbps()) {
+            update.max_bitrate_kbps = request->max_bitrate_kbps();
+            update.has_max_bitrate_kbps = 1;
+        }
+        if (request->has_adaptive_bitrate()) {
+            update.adaptive_bitrate = request->adaptive_bitrate() ? 1 : 0;
+            update.has_adaptive_bitrate = 1;
+        }
+        if (request->has_fec()) {
+            update.fec = strdup(request->fec().c_str());
+            update.has_fec = 1;
+        }
+        if (request->has_fec_percentage()) {
+            update.fec_percentage = request->fec_percentage();
+            update.has_fec_percentage = 1;
+        }
+        if (request->has_rtx()) {
+            update.rtx = request->rtx() ? 1 : 0;
+            update.has_rtx = 1;
+        }
+        if (request->has_rtx_history_ms()) {
+            update.rtx_history_ms = request->rtx_history_ms();
+            update.has_rtx_history_ms = 1;
+        }
+        if (request->has_tx_mode()) {
+            update.tx_mode = strdup(request->tx_mode().c_str());
+            update.has_tx_mode = 1;
+        }
+        if (request->has_pacing_factor()) {
+            update.pacing_factor = request->pacing_factor();
+            update.has_pacing_factor = 1;
+        }
+        if (request->has_pacing_max_delay_ms()) {
+            update.pacing_max_delay_ms = request->pacing_max_delay_ms();
+            update.has_pacing_max_delay_ms = 1;
+        }
+        if (request->has_rtp_mtu()) {
+            update.rtp_mtu = request->rtp_mtu();
+            update.has_rtp_mtu = 1;
+        }
+        if (request->has_rtp_aggregate()) {
+            update.rtp_aggregate = strdup(request->rtp_aggregate().c_str());
+            update.has_rtp_aggregate = 1;
+        }
+        if (request->has_dscp()) {
+            update.dscp = request->dscp();
+            update.has_dscp = 1;
+        }
+        if (request->has_socket_priority()) {
+            update.socket_priority = request->socket_priority();
+            update.has_socket_priority = 1;
+        }
+        if (request->has_send_buffer_kb()) {
+            update.send_buffer_kb = request->send_buffer_kb();
+            update.has_send_buffer_kb = 1;
+        }
 
         grpc_config_t new_config = {0};
         char* error_msg = nullptr;
@@ -136,29 +657,30 @@ public:
         }
 
         if (success) {
-            auto* cfg = response->mutable_config();
-            if (new_config.host) cfg->set_host(new_config.host);
-            cfg->set_port(new_config.port);
-            if (new_config.camera_name) cfg->set_camera_name(new_config.camera_name);
-            if (new_config.encoder_type) cfg->set_encoder_type(new_config.encoder_type);
-            cfg->set_width(new_config.width);
-            cfg->set_height(new_config.height);
-            cfg->set_framerate(new_config.framerate);
+            FillConfigMessage(new_config, response->mutable_config());
         }
 
         // Cleanup
         free((void*)update.host);
         free((void*)update.camera_name);
         free((void*)update.encoder_type);
-        free(new_config.host);
-        free(new_config.camera_name);
-        free(new_config.encoder_type);
+        free((void*)update.source_type);
+        free((void*)update.source_device);
+        free((void*)update.test_pattern);
+        free((void*)update.test_motion);
+        free((void*)update.capture_mode);
+        free((void*)update.pixel_format);
+        free((void*)update.fec);
+        free((void*)update.tx_mode);
+        free((void*)update.rtp_aggregate);
+        FreeConfigStrings(&new_config);
 
         return Status::OK;
     }
 
     Status SwapResolution(ServerContext* context, const SwapResolutionRequest* request,
                           SwapResolutionResponse* response) override {
+        RpcTimer timer(rpc_latency_, RPC_SWAP_RESOLUTION);
         grpc_config_t new_config = {0};
         char* error_msg = nullptr;
         int swap = request->swap();
@@ -173,18 +695,8 @@ public:
         }
 
         if (success) {
-            auto* cfg = response->mutable_config();
-            if (new_config.host) cfg->set_host(new_config.host);
-            cfg->set_port(new_config.port);
-            if (new_config.camera_name) cfg->set_camera_name(new_config.camera_name);
-            if (new_config.encoder_type) cfg->set_encoder_type(new_config.encoder_type);
-            cfg->set_width(new_config.width);
-            cfg->set_height(new_config.height);
-            cfg->set_framerate(new_config.framerate);
-
-            free(new_config.host);
-            free(new_config.camera_name);
-            free(new_config.encoder_type);
+            FillConfigMessage(new_config, response->mutable_config());
+            FreeConfigStrings(&new_config);
         }
 
         return Status::OK;
@@ -192,6 +704,7 @@ public:
 
     Status UpdateHost(ServerContext* context, const UpdateHostRequest* request,
                       UpdateHostResponse* response) override {
+        RpcTimer timer(rpc_latency_, RPC_UPDATE_HOST);
         char* error_msg = nullptr;
         int success = callbacks_.update_host_callback(callbacks_.user_data, request->host().c_str(), &error_msg);
 
@@ -208,6 +721,7 @@ public:
 
     Status GetAvailableDevices(ServerContext* context, const GetAvailableDevicesRequest* request,
                                GetAvailableDevicesResponse* response) override {
+        RpcTimer timer(rpc_latency_, RPC_GET_AVAILABLE_DEVICES);
         grpc_devices_t devices = {0};
         callbacks_.get_devices_callback(callbacks_.user_data, &devices);
 
@@ -215,11 +729,10 @@ public:
 
         // Add cameras
         for (int i = 0; i < devices.num_cameras; i++) {
-            auto* cam = devs->add_cameras();
-            if (devices.cameras[i].name) cam->set_name(devices.cameras[i].name);
-            if (devices.cameras[i].path) cam->set_path(devices.cameras[i].path);
+            FillCameraMessage(devices.cameras[i], devs->add_cameras());
             free(devices.cameras[i].name);
             free(devices.cameras[i].path);
+            free(devices.cameras[i].caps);
         }
 
         // Add encoders
@@ -227,7 +740,22 @@ public:
             auto* enc = devs->add_encoders();
             if (devices.encoders[i].name) enc->set_name(devices.encoders[i].name);
             enc->set_available(devices.encoders[i].available);
+            enc->set_usable(devices.encoders[i].usable);
+            if (devices.encoders[i].formats) {
+                std::string formats(devices.encoders[i].formats);
+                size_t start = 0;
+                while (start < formats.size()) {
+                    size_t end = formats.find(',', start);
+                    if (end == std::string::npos) end = formats.size();
+                    if (end > start) enc->add_input_formats(formats.substr(start, end - start));
+                    start = end + 1;
+                }
+            }
+            enc->set_max_width(devices.encoders[i].max_width);
+            enc->set_max_height(devices.encoders[i].max_height);
+            enc->set_max_framerate(devices.encoders[i].max_framerate);
             free(devices.encoders[i].name);
+            free(devices.encoders[i].formats);
         }
 
         free(devices.cameras);
@@ -236,8 +764,214 @@ public:
         return Status::OK;
     }
 
+    Status GetLatencyBreakdown(ServerContext* context, const GetLatencyBreakdownRequest* request,
+                               GetLatencyBreakdownResponse* response) override {
+        RpcTimer timer(rpc_latency_, RPC_GET_LATENCY_BREAKDOWN);
+        grpc_latency_t latency = {0};
+        callbacks_.get_latency_callback(callbacks_.user_data, request->reset() ? 1 : 0, &latency);
+
+        for (int i = 0; i < latency.num_stages; i++) {
+            const grpc_latency_stage_t& src = latency.stages[i];
+            auto* stage = response->add_stages();
+            stage->set_stage(src.stage);
+            stage->set_element(src.element);
+            stage->set_samples(src.samples);
+            stage->set_p50_ms(src.p50_ms);
+            stage->set_p95_ms(src.p95_ms);
+            stage->set_p99_ms(src.p99_ms);
+            stage->set_max_ms(src.max_ms);
+        }
+
+        return Status::OK;
+    }
+
+    Status WatchCameras(ServerContext* context, const WatchCamerasRequest* request,
+                        ServerWriter<CameraEvent>* writer) override {
+        // Subscribe before taking the snapshot so no hotplug event falls in between
+        auto sub = camera_hub_.Subscribe();
+
+        grpc_devices_t devices = {0};
+        callbacks_.get_devices_callback(callbacks_.user_data, &devices);
+        bool ok = true;
+        for (int i = 0; i < devices.num_cameras; i++) {
+            if (ok) {
+                CameraEvent event;
+                event.set_type(CameraEvent::ADDED);
+                event.set_initial(true);
+                FillCameraMessage(devices.cameras[i], event.mutable_camera());
+                ok = writer->Write(event);
+            }
+            free(devices.cameras[i].name);
+            free(devices.cameras[i].path);
+            free(devices.cameras[i].caps);
+        }
+        for (int i = 0; i < devices.num_encoders; i++) {
+            free(devices.encoders[i].name);
+            free(devices.encoders[i].formats);
+        }
+        free(devices.cameras);
+        free(devices.encoders);
+
+        while (ok && !context->IsCancelled()) {
+            std::deque<CameraEvent> pending;
+            {
+                std::unique_lock<std::mutex> lock(sub->mutex);
+                sub->cv.wait_for(lock, std::chrono::seconds(1),
+                                 [&sub] { return sub->closed || !sub->queue.empty(); });
+                if (sub->closed) {
+                    break;
+                }
+                pending.swap(sub->queue);
+            }
+            for (const auto& event : pending) {
+                if (!writer->Write(event)) {
+                    ok = false;
+                    break;
+                }
+            }
+        }
+
+        camera_hub_.Unsubscribe(sub);
+        return Status::OK;
+    }
+
+    Status ReportReceiverFeedback(ServerContext* context, const ReportReceiverFeedbackRequest* request,
+                                  ReportReceiverFeedbackResponse* response) override {
+        RpcTimer timer(rpc_latency_, RPC_REPORT_RECEIVER_FEEDBACK);
+        uint32_t target_kbps = callbacks_.report_feedback_callback(callbacks_.user_data,
+                                                                   request->fraction_lost(), request->rtt_ms());
+        response->set_target_bitrate_kbps(target_kbps);
+        return Status::OK;
+    }
+
+    Status AddDestination(ServerContext* context, const AddDestinationRequest* request,
+                          DestinationResponse* response) override {
+        RpcTimer timer(rpc_latency_, RPC_ADD_DESTINATION);
+        char* error_msg = nullptr;
+        int success = callbacks_.add_destination_callback(callbacks_.user_data, request->host().c_str(),
+                                                          request->port(), &error_msg);
+
+        response->set_success(success != 0);
+        if (error_msg) {
+            response->set_message(error_msg);
+            free(error_msg);
+        } else {
+            response->set_message(success ? "Destination added" : "Failed to add destination");
+        }
+
+        return Status::OK;
+    }
+
+    Status RemoveDestination(ServerContext* context, const RemoveDestinationRequest* request,
+                             DestinationResponse* response) override {
+        RpcTimer timer(rpc_latency_, RPC_REMOVE_DESTINATION);
+        char* error_msg = nullptr;
+        int success = callbacks_.remove_destination_callback(callbacks_.user_data, request->host().c_str(),
+                                                             request->port(), &error_msg);
+
+        response->set_success(success != 0);
+        if (error_msg) {
+            response->set_message(error_msg);
+            free(error_msg);
+        } else {
+            response->set_message(success ? "Destination removed" : "Failed to remove destination");
+        }
+
+        return Status::OK;
+    }
+
+    Status ListDestinations(ServerContext* context, const ListDestinationsRequest* request,
+                            ListDestinationsResponse* response) override {
+        RpcTimer timer(rpc_latency_, RPC_LIST_DESTINATIONS);
+        grpc_destinations_t destinations = {};
+        callbacks_.list_destinations_callback(callbacks_.user_data, &destinations);
+
+        for (int i = 0; i < destinations.num_destinations; i++) {
+            const grpc_destination_t& src = destinations.destinations[i];
+            auto* dst = response->add_destinations();
+            dst->set_host(src.host);
+            dst->set_port(src.port);
+            dst->set_primary(src.primary != 0);
+            dst->set_bytes_sent(src.bytes_sent);
+            dst->set_packets_sent(src.packets_sent);
+        }
+
+        return Status::OK;
+    }
+
+    Status GetFrameAnalytics(ServerContext* context, const GetFrameAnalyticsRequest* request,
+                             GetFrameAnalyticsResponse* response) override {
+        RpcTimer timer(rpc_latency_, RPC_GET_FRAME_ANALYTICS);
+        grpc_frame_analytics_t analytics = {0};
+        callbacks_.get_frame_analytics_callback(callbacks_.user_data, &analytics);
+
+        for (int i = 0; i < analytics.num_types; i++) {
+            const grpc_frame_type_stats_t& src = analytics.types[i];
+            auto* type = response->add_types();
+            type->set_type(src.type);
+            type->set_frames(src.frames);
+            type->set_bytes(src.bytes);
+            type->set_avg_bytes(src.frames ? src.bytes / src.frames : 0);
+            type->set_max_bytes(src.max_bytes);
+            for (int b = 0; b < GRPC_FRAME_SIZE_BUCKETS; b++) {
+                auto* bucket = type->add_sizes();
+                bucket->set_le_bytes(b < GRPC_FRAME_SIZE_BUCKETS - 1 ? 1024ull << b : 0);
+                bucket->set_frames(src.buckets[b]);
+            }
+        }
+        response->set_gops(analytics.gops);
+        response->set_last_gop_length(analytics.last_gop_length);
+        response->set_min_gop_length(analytics.min_gop_length);
+        response->set_max_gop_length(analytics.max_gop_length);
+        response->set_avg_gop_length(analytics.avg_gop_length);
+        response->set_sps_count(analytics.sps_count);
+        response->set_pps_count(analytics.pps_count);
+
+        return Status::OK;
+    }
+
+    Status WatchStats(ServerContext* context, const WatchStatsRequest* request,
+                      ServerWriter<StatsSample>* writer) override {
+        uint32_t interval_ms = request->interval_ms();
+        if (interval_ms == 0) {
+            interval_ms = 1000;
+        }
+        interval_ms = std::max<uint32_t>(50, std::min<uint32_t>(interval_ms, 60000));
+
+        auto sub = stats_broadcaster_.Subscribe(std::chrono::milliseconds(interval_ms));
+        while (!context->IsCancelled()) {
+            std::shared_ptr<const f1sh_camera::StreamStats> stats;
+            uint64_t sequence = 0;
+            uint64_t skipped = 0;
+            if (!stats_broadcaster_.Next(sub, std::chrono::seconds(1), &stats, &sequence, &skipped)) {
+                break;
+            }
+            if (!stats) {
+                continue;
+            }
+
+            StatsSample sample;
+            *sample.mutable_stats() = *stats;
+            sample.set_sequence(sequence);
+            sample.set_skipped(skipped);
+            if (!writer->Write(sample)) {
+                break;
+            }
+        }
+
+        stats_broadcaster_.Unsubscribe(sub);
+        return Status::OK;
+    }
+
+    CameraEventHub& camera_hub() { return camera_hub_; }
+    StatsBroadcaster& stats_broadcaster() { return stats_broadcaster_; }
+    const RpcLatency& rpc_latency() const { return rpc_latency_; }
+
 private:
     grpc_callbacks callbacks_;
+    CameraEventHub camera_hub_;
+    StatsBroadcaster stats_broadcaster_;
+    RpcLatency rpc_latency_;
 };
 
 // C wrapper implementation
@@ -274,6 +1008,10 @@ extern "C" f1sh_grpc_server_t* f1sh_grpc_server_start(const char* address, const
 
 extern "C" void f1sh_grpc_server_stop(f1sh_grpc_server_t* server) {
     if (server) {
+        if (server->service) {
+            server->service->camera_hub().CloseAll();
+            server->service->stats_broadcaster().Close();
+        }
         if (server->server) {
             server->server->Shutdown();
         }
@@ -286,3 +1024,21 @@ extern "C" void f1sh_grpc_server_wait(f1sh_grpc_server_t* server) {
         server->server->Wait();
     }
 }
+
+extern "C" void f1sh_grpc_server_notify_camera(f1sh_grpc_server_t* server, int added,
+                                               const grpc_camera_info_t* camera) {
+    if (!server || !server->service || !camera) {
+        return;
+    }
+    CameraEvent event;
+    event.set_type(added ? CameraEvent::ADDED : CameraEvent::REMOVED);
+    FillCameraMessage(*camera, event.mutable_camera());
+    server->service->camera_hub().Publish(event);
+}
+
+extern "C" int f1sh_grpc_server_get_rpc_latency(f1sh_grpc_server_t* server, grpc_rpc_latency_t* out, int max) {
+    if (!server || !server->service || !out || max <= 0) {
+        return 0;
+    }
+    return server->service->rpc_latency().Snapshot(out, max);
+}
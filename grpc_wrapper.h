@@ -18,8 +18,114 @@ typedef struct {
     int width;
     int height;
     int framerate;
+    char* source_type;
+    char* source_device;
+    char* test_pattern;
+    char* test_motion;
+    char* capture_mode;
+    char* pixel_format;
+    int live_renegotiate;
+    int standby_swap;
+    int rtcp;
+    int rtcp_port;
+    int bitrate_kbps;
+    int min_bitrate_kbps;
+    int max_bitrate_kbps;
+    int adaptive_bitrate;
+    char* fec;
+    int fec_percentage;
+    int rtx;
+    int rtx_history_ms;
+    char* tx_mode;
+    double pacing_factor;
+    int pacing_max_delay_ms;
+    int rtp_mtu;
+    char* rtp_aggregate;
+    int dscp;
+    int socket_priority;
+    int send_buffer_kb;
 } grpc_config_t;
 
+// RTCP receiver report from one receiver
+typedef struct {
+    uint32_t ssrc;
+    char address[64];
+    double fraction_lost;        // 0..1 over the last report interval
+    int64_t packets_lost;        // cumulative
+    double jitter_ms;
+    double rtt_ms;
+} grpc_receiver_stats_t;
+
+#define GRPC_MAX_RECEIVERS 8
+
+// Stream statistics structure
+typedef struct {
+    uint64_t total_bytes;        // RTP bytes handed to the udpsink
+    uint64_t frame_count;        // encoded frames (access units) sent
+    double bitrate;              // kbps over the last second
+    int zero_copy_active;        // 1 when frames reach the encoder as imported DMABufs
+    uint64_t dmabuf_buffers;     // encoder input buffers backed by DMABuf memory
+    uint64_t system_buffers;     // encoder input buffers in system memory
+    uint32_t dmabuf_fallbacks;   // times the DMABuf path was abandoned for the copy path
+    int conversion_in_path;      // 1 when videoconvert sits in front of the encoder
+    char negotiated_format[16];  // raw format shared by source and encoder (empty if converted)
+    uint32_t renegotiations;          // size/framerate changes applied without rebuild
+    uint32_t renegotiation_fallbacks; // in-place changes that needed a full rebuild
+    double last_renegotiation_ms;     // duration of the last in-place change
+    uint32_t restarts;                // full pipeline rebuilds since startup
+    double last_restart_ms;           // teardown-to-PLAYING time of the last (re)build
+    double last_release_wait_ms;      // part of it spent waiting for the capture device
+    uint32_t standby_swaps;           // encoder changes completed on a standby branch
+    uint32_t standby_swap_fallbacks;  // standby attempts that needed a full rebuild
+    double last_standby_swap_ms;      // standby branch creation to first IDR on the wire
+    uint64_t rtp_packets;             // RTP packets handed to the udpsink
+    uint64_t keyframes;               // encoded frames that were IDR/keyframes
+    uint64_t delta_frames;            // encoded frames that were not
+    uint64_t encoded_bytes;           // H.264 bytes before RTP packetization
+    double bitrate_5s;                // kbps over the last 5 seconds
+    double bitrate_60s;               // kbps over the last 60 seconds
+    double bitrate_ewma;              // kbps, exponentially smoothed 1 s samples
+    double packet_rate;               // RTP packets per second over the last second
+    double frame_rate;                // encoded frames per second over the last second
+    double frame_rate_5s;             // encoded frames per second over the last 5 seconds
+    uint64_t avg_idr_bytes;           // mean IDR frame size
+    uint64_t max_idr_bytes;           // largest IDR frame
+    uint64_t avg_p_bytes;             // mean P frame size
+    uint32_t last_gop_length;         // frames between the last two IDRs
+    uint64_t sps_count;               // SPS NAL units sent
+    uint64_t pps_count;               // PPS NAL units sent
+    uint32_t target_bitrate_kbps;     // bitrate the encoder is set to
+    uint32_t bitrate_increases;       // adaptive controller decisions
+    uint32_t bitrate_decreases;
+    char bitrate_decision[32];        // reason for the last change: loss, rtt, probe, config
+    double feedback_loss;             // receiver loss the controller last saw (0..1)
+    double feedback_rtt_ms;           // receiver RTT the controller last saw
+    uint64_t fec_packets;             // FEC packets produced
+    uint64_t fec_bytes;
+    uint64_t rtx_requests;            // packets NACKed by receivers
+    uint64_t rtx_packets;             // retransmissions sent
+    uint64_t rtx_bytes;
+    uint64_t tx_syscalls;             // send calls made by the branch sink
+    uint64_t tx_batches;
+    uint64_t tx_gso_sends;            // messages segmented by UDP GSO
+    double tx_syscalls_per_frame;
+    uint64_t paced_packets;           // packets through the pacer
+    double pacing_delay_avg_ms;       // wait for pacing tokens per packet
+    double pacing_delay_max_ms;
+    uint64_t pacing_overruns;         // bursts let through to stay within the max delay
+    uint32_t pacing_queue_depth;      // packets waiting in the pace queue now
+    uint32_t pacing_queue_max;
+    uint32_t rtp_mtu;                 // MTU the payloader is running with
+    double rtp_packets_per_frame;
+    double rtp_overhead_ratio;        // RTP/FEC bytes sent per H.264 byte
+    uint64_t kernel_sndbuf_errors;    // UDP sends the kernel dropped since the stream started (host-wide)
+    uint64_t tx_enobufs;              // packets the batched transmitter had refused with ENOBUFS
+    uint32_t destination_switches;    // host/port changes applied without a rebuild
+    double last_destination_switch_ms; // switch request to the first IDR for the new host
+    grpc_receiver_stats_t receivers[GRPC_MAX_RECEIVERS]; // RTCP receiver reports, when enabled
+    int num_receivers;
+} grpc_stats_t;
+
 // Configuration update structure (for optional fields)
 typedef struct {
     const char* host;
@@ -29,6 +135,32 @@ typedef struct {
     int width;
     int height;
     int framerate;
+    const char* source_type;
+    const char* source_device;
+    const char* test_pattern;
+    const char* test_motion;
+    const char* capture_mode;
+    const char* pixel_format;
+    int live_renegotiate;
+    int standby_swap;
+    int rtcp;
+    int rtcp_port;
+    int bitrate_kbps;
+    int min_bitrate_kbps;
+    int max_bitrate_kbps;
+    int adaptive_bitrate;
+    const char* fec;
+    int fec_percentage;
+    int rtx;
+    int rtx_history_ms;
+    const char* tx_mode;
+    double pacing_factor;
+    int pacing_max_delay_ms;
+    int rtp_mtu;
+    const char* rtp_aggregate;
+    int dscp;
+    int socket_priority;
+    int send_buffer_kb;
     // Flags to indicate which fields are set
     int has_host;
     int has_port;
@@ -37,18 +169,50 @@ typedef struct {
     int has_width;
     int has_height;
     int has_framerate;
+    int has_source_type;
+    int has_source_device;
+    int has_test_pattern;
+    int has_test_motion;
+    int has_capture_mode;
+    int has_pixel_format;
+    int has_live_renegotiate;
+    int has_standby_swap;
+    int has_rtcp;
+    int has_rtcp_port;
+    int has_bitrate_kbps;
+    int has_min_bitrate_kbps;
+    int has_max_bitrate_kbps;
+    int has_adaptive_bitrate;
+    int has_fec;
+    int has_fec_percentage;
+    int has_rtx;
+    int has_rtx_history_ms;
+    int has_tx_mode;
+    int has_pacing_factor;
+    int has_pacing_max_delay_ms;
+    int has_rtp_mtu;
+    int has_rtp_aggregate;
+    int has_dscp;
+    int has_socket_priority;
+    int has_send_buffer_kb;
 } grpc_config_update_t;
 
 // Camera info structure
 typedef struct {
     char* name;
     char* path;
+    char* caps;          // supported caps as a string
 } grpc_camera_info_t;
 
 // Encoder info structure
 typedef struct {
     char* name;
     int available;
+    int usable;          // a test instance opened at startup
+    char* formats;       // comma-separated raw input formats
+    int max_width;       // 0 when unknown
+    int max_height;
+    int max_framerate;
 } grpc_encoder_info_t;
 
 // Available devices structure
@@ -59,6 +223,68 @@ typedef struct {
     int num_encoders;
 } grpc_devices_t;
 
+// Buffer latency leaving one pipeline stage, measured as running time minus buffer PTS.
+// Values are cumulative from capture, so the cost of a stage is the step from the one before.
+typedef struct {
+    char stage[16];      // source, capsfilter, convert, queue, encoder, parser, payloader, sink
+    char element[32];    // element the probe sits on
+    unsigned long long samples;
+    double p50_ms;
+    double p95_ms;
+    double p99_ms;
+    double max_ms;
+} grpc_latency_stage_t;
+
+#define GRPC_MAX_LATENCY_STAGES 8
+
+typedef struct {
+    grpc_latency_stage_t stages[GRPC_MAX_LATENCY_STAGES];
+    int num_stages;
+} grpc_latency_t;
+
+// Encoded frame sizes of one picture type. buckets[i] counts frames up to 1 KiB << i
+// bytes (not cumulative); the last bucket holds everything larger.
+#define GRPC_FRAME_SIZE_BUCKETS 11
+
+typedef struct {
+    char type[8];        // IDR, I, P or B
+    uint64_t frames;
+    uint64_t bytes;
+    uint64_t max_bytes;
+    uint64_t buckets[GRPC_FRAME_SIZE_BUCKETS];
+} grpc_frame_type_stats_t;
+
+#define GRPC_MAX_FRAME_TYPES 4
+
+typedef struct {
+    grpc_frame_type_stats_t types[GRPC_MAX_FRAME_TYPES];
+    int num_types;
+    uint64_t gops;               // completed IDR-to-IDR intervals
+    uint32_t last_gop_length;
+    uint32_t min_gop_length;
+    uint32_t max_gop_length;
+    double avg_gop_length;
+    uint64_t sps_count;
+    uint64_t pps_count;
+} grpc_frame_analytics_t;
+
+// One UDP receiver of the media stream. Counters come from the sink feeding the network
+// and restart with each pipeline build.
+typedef struct {
+    char host[64];
+    int port;
+    int primary;         // config host:port; the others were added with AddDestination
+    uint64_t bytes_sent;
+    uint64_t packets_sent;
+} grpc_destination_t;
+
+#define GRPC_MAX_DESTINATIONS 17
+
+typedef struct {
+    grpc_destination_t destinations[GRPC_MAX_DESTINATIONS];
+    int num_destinations;
+} grpc_destinations_t;
+
 // Callback structure - these are called by gRPC server when requests come in
 typedef struct {
     // Health check callback
@@ -66,8 +292,8 @@ typedef struct {
     void (*health_callback)(void* user_data, char** status_out);
 
     // Get stats callback
-    // Output: Fill in the three stats pointers
-    void (*get_stats_callback)(void* user_data, uint64_t* total_bytes, uint64_t* frame_count, double* bitrate);
+    // Output: Fill in the stats structure
+    void (*get_stats_callback)(void* user_data, grpc_stats_t* stats);
 
     // Get config callback
     // Output: Fill in config structure (strings should be allocated with malloc/strdup)
@@ -96,6 +322,30 @@ typedef struct {
     // Output: devices structure (all strings and arrays should be allocated)
     void (*get_devices_callback)(void* user_data, grpc_devices_t* devices);
 
+    // Get latency breakdown callback
+    // Input: reset (nonzero clears the histograms after reading)
+    // Output: Fill in the latency structure
+    void (*get_latency_callback)(void* user_data, int reset, grpc_latency_t* latency);
+
+    // Get frame analytics callback
+    // Output: Fill in the analytics structure
+    void (*get_frame_analytics_callback)(void* user_data, grpc_frame_analytics_t* analytics);
+
+    // Receiver feedback callback
+    // Input: loss fraction (0..1) and round-trip time seen by a receiver
+    // Return: the current target bitrate in kbps
+    uint32_t (*report_feedback_callback)(void* user_data, double fraction_lost, double rtt_ms);
+
+    // Add/remove an extra receiver of the media stream
+    // Output: error_msg if failed (allocated)
+    // Return: 1 for success, 0 for failure
+    int (*add_destination_callback)(void* user_data, const char* host, int port, char** error_msg);
+    int (*remove_destination_callback)(void* user_data, const char* host, int port, char** error_msg);
+
+    // List destinations callback
+    // Output: Fill in the destinations structure, primary first
+    void (*list_destinations_callback)(void* user_data, grpc_destinations_t* destinations);
+
     // User data pointer passed to all callbacks
     void* user_data;
 } grpc_callbacks;
@@ -115,6 +365,26 @@ void f1sh_grpc_server_stop(f1sh_grpc_server_t* server);
 // Wait for server to finish (blocking)
 void f1sh_grpc_server_wait(f1sh_grpc_server_t* server);
 
+// Latency of unary RPCs, bucketed by upper bound in milliseconds. buckets[] are
+// per-bucket counts, not cumulative; the last one holds calls slower than every bound.
+#define GRPC_RPC_LATENCY_BOUNDS_MS { 1, 2.5, 5, 10, 25, 50, 100, 250, 500, 1000 }
+#define GRPC_RPC_LATENCY_BUCKETS 11
+
+typedef struct {
+    const char* method;  // static string, do not free
+    unsigned long long count;
+    double sum_ms;
+    unsigned long long buckets[GRPC_RPC_LATENCY_BUCKETS];
+} grpc_rpc_latency_t;
+
+// Copy per-method RPC latency into out (up to max entries)
+// Returns: number of entries written
+int f1sh_grpc_server_get_rpc_latency(f1sh_grpc_server_t* server, grpc_rpc_latency_t* out, int max);
+
+// Push a camera hotplug event to WatchCameras subscribers
+// added: 1 = camera appeared, 0 = camera went away; strings are copied
+void f1sh_grpc_server_notify_camera(f1sh_grpc_server_t* server, int added, const grpc_camera_info_t* camera);
+
 #ifdef __cplusplus
 }
 #endif
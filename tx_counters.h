@@ -0,0 +1,31 @@
+#ifndef TX_COUNTERS_H
+#define TX_COUNTERS_H
+
+#include <glib.h>
+#include <stdatomic.h>
+
+// Counters bumped for every buffer on any sink streaming thread (active and standby sinks,
+// the pace queue). Both are independent monotonic atomics read with relaxed loads, so a
+// snapshot may be one buffer apart between bytes and packets; rates are not affected.
+typedef struct {
+    atomic_uint_fast64_t total_bytes;
+    atomic_uint_fast64_t packets;
+} TxCounters;
+
+static inline void tx_counters_add(TxCounters *tx, guint64 bytes, guint64 packets) {
+    atomic_fetch_add_explicit(&tx->total_bytes, bytes, memory_order_relaxed);
+    atomic_fetch_add_explicit(&tx->packets, packets, memory_order_relaxed);
+}
+
+static inline void tx_counters_read(TxCounters *tx, guint64 *bytes_out, guint64 *packets_out) {
+    *bytes_out = atomic_load_explicit(&tx->total_bytes, memory_order_relaxed);
+    *packets_out = atomic_load_explicit(&tx->packets, memory_order_relaxed);
+}
+
+// Only called while no pipeline is streaming
+static inline void tx_counters_reset(TxCounters *tx) {
+    atomic_store(&tx->total_bytes, 0);
+    atomic_store(&tx->packets, 0);
+}
+
+#endif // TX_COUNTERS_H